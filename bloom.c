@@ -0,0 +1,83 @@
+/*  File: bloom.c
+ *  Author: Richard Durbin (rd109@cam.ac.uk)
+ *  Copyright (C) Richard Durbin, Cambridge University, 2026
+ *-------------------------------------------------------------------
+ * Description: blocked Bloom filter
+   All the bits for a key are in one 64 byte block, so a lookup touches one cache line.  This
+   costs a little in false positive rate over a plain Bloom filter: with 8 bits per key and
+   nHash 3 it is about 4%, as against 3%.  The block comes from the top bits of one multiply
+   of the key, and the bits within it from successive 9 bit fields of a second, mixed.
+ * Exported functions: see bloom.h
+ * HISTORY:
+ * Last edited: Oct 16 11:02 2026 (rd109)
+ * Created: Fri Oct 16 09:14:27 2026 (rd109)
+ *-------------------------------------------------------------------
+ */
+
+#include "bloom.h"
+
+Bloom *bloomCreate (int bits, int nHash)
+{
+  if (bits < 9 || bits > 40) die ("Bloom filter bits %d must be between 9 and 40", bits) ;
+  if (nHash < 1 || nHash > 7) die ("Bloom filter nHash %d must be between 1 and 7", nHash) ;
+  Bloom *b = new0 (1, Bloom) ;
+  b->bits = bits ;
+  b->nHash = nHash ;
+  b->blockMask = ((U64)1 << (bits - 9)) - 1 ;
+  b->block = (U64*) aligned_alloc (64, ((U64)1 << bits) / 8) ;
+  if (!b->block) die ("failed to allocate Bloom filter of %d bits", bits) ;
+  memset (b->block, 0, ((U64)1 << bits) / 8) ;
+  return b ;
+}
+
+void bloomDestroy (Bloom *b) { free (b->block) ; free (b) ; }
+
+static inline U64 *blockFind (Bloom *b, U64 key, U64 *h)
+{ U64 y = key * 0xc4ceb9fe1a85ec53ULL ;
+  *h = y ^ (y >> 32) ;		/* so the low bits depend on all of key */
+  return b->block + 8 * (((key * 0xff51afd7ed558ccdULL) >> 24) & b->blockMask) ;
+}
+
+bool bloomAdd (Bloom *b, U64 key)
+{
+  U64 h, *x = blockFind (b, key, &h) ;
+  bool isThere = true ;
+  int i ;
+  for (i = 0 ; i < b->nHash ; ++i, h >>= 9)
+    { U64 *w = x + ((h >> 6) & 0x7), m = (U64)1 << (h & 0x3f) ;
+      if (!(*w & m)) { isThere = false ; *w |= m ; }
+    }
+  return isThere ;
+}
+
+bool bloomAddAtomic (Bloom *b, U64 key)
+{
+  U64 h, *x = blockFind (b, key, &h) ;
+  bool isThere = true ;
+  int i ;
+  for (i = 0 ; i < b->nHash ; ++i, h >>= 9)
+    { U64 *w = x + ((h >> 6) & 0x7), m = (U64)1 << (h & 0x3f) ;
+      if (!(__atomic_load_n (w, __ATOMIC_RELAXED) & m)
+	  && !(__atomic_fetch_or (w, m, __ATOMIC_RELAXED) & m))
+	isThere = false ;
+    }
+  return isThere ;
+}
+
+bool bloomFind (Bloom *b, U64 key)
+{
+  U64 h, *x = blockFind (b, key, &h) ;
+  int i ;
+  for (i = 0 ; i < b->nHash ; ++i, h >>= 9)
+    if (!(x[(h >> 6) & 0x7] & ((U64)1 << (h & 0x3f)))) return false ;
+  return true ;
+}
+
+double bloomFill (Bloom *b)
+{
+  U64 i, n = 0, nWord = ((U64)1 << b->bits) / 64 ;
+  for (i = 0 ; i < nWord ; ++i) n += __builtin_popcountll (b->block[i]) ;
+  return n / (double)((U64)1 << b->bits) ;
+}
+
+/*********** end of file ***********/
@@ -0,0 +1,34 @@
+/*  File: bloom.h
+ *  Author: Richard Durbin (rd109@cam.ac.uk)
+ *  Copyright (C) Richard Durbin, Cambridge University, 2026
+ *-------------------------------------------------------------------
+ * Description: header file for a blocked Bloom filter on U64 keys
+ * Exported functions: see below
+ * HISTORY:
+ * Last edited: Oct 16 11:02 2026 (rd109)
+ * Created: Fri Oct 16 09:14:27 2026 (rd109)
+ *-------------------------------------------------------------------
+ */
+
+#include "utils.h"
+
+#ifndef BLOOM_DEFINED
+#define BLOOM_DEFINED
+
+typedef struct {
+  int bits ;			/* the filter has 2^bits bits */
+  int nHash ;			/* bits set per key, all in one 64 byte block */
+  U64 blockMask ;		/* number of blocks - 1 */
+  U64 *block ;			/* 8 U64 per block */
+} Bloom ;
+
+Bloom *bloomCreate (int bits, int nHash) ; /* bits >= 9 */
+void bloomDestroy (Bloom *b) ;
+bool bloomAdd (Bloom *b, U64 key) ;	   /* add key, returning true if it was already there */
+bool bloomAddAtomic (Bloom *b, U64 key) ;  /* thread-safe version */
+bool bloomFind (Bloom *b, U64 key) ;	   /* true if key may be there */
+double bloomFill (Bloom *b) ;		   /* fraction of bits set */
+
+#endif
+
+/*********** end of file ***********/
@@ -139,6 +139,7 @@ static void hashDouble (TRUE_HASH *h)
   for (i = 0, kp = oldKeys ; i < oldsize ; ++i, ++kp)
     if (*kp && *kp != REMOVED)
       { hk.i = *kp ; HASH_FUNC(hk) ;
+	delta = 0 ;		/* DELTA() is per key */
         while (true)
           if (!h->keys[hash])  /* don't need to test REMOVED */
 	    { h->keys[hash] = *kp ;
@@ -128,8 +128,8 @@ void readsetWrite (Readset *rs, char *root)
 Readset *readsetRead (char *root)
 {
   FILE *f ;
-  if (!(f = fopenTag (root, "mod", "r"))) die ("can't open file %s.mod", root) ;
-  Modset *ms = modsetRead (f) ; fclose (f) ;
+  char modName[strlen(root)+5] ; sprintf (modName, "%s.mod", root) ;
+  Modset *ms = modsetOpen (modName) ;
   if (!(f = fopenTag (root, "readset", "r"))) die ("can't open file %s.readset", root) ;
   char name[8] ;
   if (fread (name,8,1,f) != 1) die ("failed to read readset header") ;
@@ -155,27 +155,30 @@ void readsetFileRead (Readset *rs, char *filename)
   Array hitsA = arrayCreate (1024, U32) ; /* reuse these to build the lists of hits and dx */
   Array dxA = arrayCreate (1024, U16) ;
 
-  memset (rs->ms->depth, 0, (rs->ms->max+1)*sizeof(U16)) ; /* rebuild depth from this file */
-  dna2indexConv['N'] = dna2indexConv['n'] = 0 ; /* to get 2-bit encoding */
+  memset (rs->ms->depth, 0, (rs->ms->max+1)*sizeof(U8)) ; /* rebuild depth from this file */
   SeqIO *si = seqIOopenRead (filename, dna2indexConv, false) ;
+  if (si->type == BINARY) si->isPacked = true ; /* hash directly from the packed sequence */
+  SeqhashBatch *sb = seqhashBatchCreate (1 << 16) ; /* reused for every read */
   while (seqIOread (si))
     { Read *read = arrayp(rs->reads, arrayMax(rs->reads), Read) ;
       read->len = si->seqLen ;
-      SeqhashRCiterator *mi = modRCiterator (rs->ms->hasher, sqioSeq(si), si->seqLen) ;
       hitsA = arrayReCreate (hitsA, 1024, U32) ;
       dxA = arrayReCreate (dxA, 1024, U16) ;
-      U64 kmer ; int lastPos = 0, pos ; bool isForward ;
-      while (modRCnext (mi, &kmer, &pos, &isForward))
-	{ U32 index = modsetIndexFind (rs->ms, kmer, false) ;
+      int j, n = si->isPacked ?
+	modRCbatchPacked (rs->ms->hasher, sqioSeqPacked(si), 0, si->seqLen, sb) :
+	modRCbatch (rs->ms->hasher, sqioSeq(si), si->seqLen, sb) ;
+      int lastPos = 0 ;
+      modsetIndexFindBatch (rs->ms, sb, false) ;
+      for (j = 0 ; j < n ; ++j)
+	{ U32 index = sb->index[j] ;
 	  if (index)
-	    { array(hitsA,read->nHit,U32) = isForward ? (index | TOPBIT) : index ;
-	      array(dxA,read->nHit,U16) = pos - lastPos ; lastPos = pos ;
+	    { array(hitsA,read->nHit,U32) = sb->isF[j] ? (index | TOPBIT) : index ;
+	      array(dxA,read->nHit,U16) = sb->pos[j] - lastPos ; lastPos = sb->pos[j] ;
 	      ++read->nHit ;
-	      U16 *di = &rs->ms->depth[index] ; ++*di ; if (!*di) *di = U16MAX ;
+	      msDepthAdd (rs->ms, index, 1) ;
 	    }
 	  else ++read->nMiss ;
 	}
-      seqhashRCiteratorDestroy (mi) ;
       if (read->nHit)
 	{ read->hit = new (read->nHit, U32) ;
 	  memcpy (read->hit, arrp(hitsA,0,U32), read->nHit*sizeof(U32)) ;
@@ -184,6 +187,7 @@ void readsetFileRead (Readset *rs, char *filename)
 	  rs->totHit += read->nHit ;
 	}
     }
+  seqhashBatchDestroy (sb) ;
   seqIOclose (si) ;
 
   invBuild (rs) ;
@@ -245,8 +249,8 @@ void readsetStats (Readset *rs)
   for (i = 1 ; i <= rs->ms->max ; ++i)
     { j = msCopy(rs->ms,i) ;
       ++nCopy[j] ;
-      if (rs->ms->depth[i] > 0) ++hitCopy[j] ;
-      if (rs->ms->depth[i] > 1) { ++hit2Copy[j] ; depthCopy[j] += rs->ms->depth[i] ; }
+      if (msDepth (rs->ms, i) > 0) ++hitCopy[j] ;
+      if (msDepth (rs->ms, i) > 1) { ++hit2Copy[j] ; depthCopy[j] += msDepth (rs->ms, i) ; }
     }
   fprintf (outFile, "RS mod frac hit hit>1 av: copy0 %.3f %.3f %.1f copy1 %.3f %.3f %.1f copy2 %.3f %.3f %.1f copyM %.3f %.3f %.1f\n", 
    hitCopy[0]/(double)nCopy[0], hit2Copy[0]/(double)nCopy[0], depthCopy[0]/(double)hit2Copy[0], 
@@ -264,9 +268,9 @@ static void invBuild (Readset *rs) /* run this after ms->depth built from reads-
   else rs->inv = new0 (ms->max+1, U32*) ;
   if (!rs->invSpace) rs->invSpace = new (rs->totHit, U32) ;
   for (i = 1 ; i <= ms->max ; ++i)
-    if (ms->depth[i] && ms->depth[i] < U16MAX)
+    if (msDepth (ms, i))
       { rs->inv[i] = rs->invSpace + offset ;
-	offset += ms->depth[i] ;
+	offset += msDepth (ms, i) ;
       }
   Read *read = arrp(rs->reads,1,Read) ;
   for (i = 1 ; i < arrayMax(rs->reads) ; ++i, ++read)
@@ -275,14 +279,14 @@ static void invBuild (Readset *rs) /* run this after ms->depth built from reads-
       for (j = 0 ; j < read->nHit ; ++j, ++x)
 	{ U32 y = *x & TOPMASK ;
 	  ++read->nCopy[msCopy(rs->ms,y)] ;
-	  if (ms->depth[y] < U16MAX) *rs->inv[y]++ = i ; /* this is the inverse map */
+	  *rs->inv[y]++ = i ; /* this is the inverse map */
 	}
     }
   offset = 0 ; /* now recreate rs->inv because we moved the pointers */
   for (i = 1 ; i <= ms->max ; ++i)
-    if (ms->depth[i] && ms->depth[i] < U16MAX)
+    if (msDepth (ms, i))
       { rs->inv[i] = rs->invSpace + offset ;
-	offset += ms->depth[i] ;
+	offset += msDepth (ms, i) ;
       }
 }
 
@@ -335,8 +339,8 @@ Array findOverlaps (Readset *rs, Read *x, int reportLevel) /* returns array of O
       if (msIsCopy1 (rs->ms, hxx))
 	{ if (hmap[hxx]) { ++nRepeat ; x->badRepeat = 1 ; continue ; }
 	  hmap[hxx] = j+1 ; /* note the +1 : needed to distinguish from missing */
-	  U32 *r2 = rs->inv[hxx] ;
-	  for (k = 0 ; k < rs->ms->depth[hxx] ; ++k, ++r2)
+	  U32 *r2 = rs->inv[hxx], depth = msDepth (rs->ms, hxx) ;
+	  for (k = 0 ; k < depth ; ++k, ++r2)
 	    { if (!omap[*r2])
 		{ o = arrayp(olap, omap[*r2] = arrayMax(olap), Overlap) ;
 		  o->iy = *r2 ;
@@ -440,7 +444,7 @@ void printOverlap (Readset *rs, U32 ix, U32 iy)
 	      if (hxx == hyy)
 		{ bool isSame = ((*hx&TOPBIT) == (*hy&TOPBIT)) ;
 		  fprintf (outFile, "RO\t%8x %5d %c\t",
-			   hxx, rs->ms->depth[hxx], isSame ? '+' : '-') ;
+			   hxx, msDepth (rs->ms, hxx), isSame ? '+' : '-') ;
 		  fprintf (outFile, "%u %u %c\t",
 			   ix, xPos, (*hx & TOPBIT) ? 'F' : 'R') ;
 		  fprintf (outFile, "%u %u %c",
@@ -531,7 +535,7 @@ void cleanMods (Readset *rs)
 	  if (isInRead[hh])  msSetRepeat(ms,hh) ;
 	  isInRead[hh] = true ;
 	  if (j && *dx < w && j+1 < r->nHit && dx[1] < w) msSetInternal(ms,hh) ;
-	  thisDepth = ms->depth[hh] ;
+	  thisDepth = msDepth (ms, hh) ;
 	  if (j)
 	    { if (lastDepth > 2*thisDepth) msSetMinor(ms,hh) ;
 	      if (thisDepth > 2*lastDepth) msSetMinor(ms,hhLast) ;
@@ -612,13 +616,13 @@ void testMods (Readset *rs, int minDepth, int maxDepth)
 
   int nTested = 0 ;
   for (i = 0 ; i < ms->max+1 ; ++i)
-    if (ms->depth[i] >= minDepth && ms->depth[i] < maxDepth && checkMod(ms,i))
+    if (msDepth (ms, i) >= minDepth && msDepth (ms, i) < maxDepth && checkMod(ms,i))
       { ++nTested ;
-	U32 *rj = rs->inv[i] ;
+	U32 *rj = rs->inv[i], depth = msDepth (ms, i) ;
 	test = arrayReCreate (test, 4096, Test) ;
 	start = arrayReCreate (start, 20000, int) ;
 	end = arrayReCreate (end, 20000, int) ;
-	for (j = 0 ; j < ms->depth[i] ; ++j, ++rj)
+	for (j = 0 ; j < depth ; ++j, ++rj)
 	  { Read *r = arrp(rs->reads, *rj, Read) ;
 	    int x = 0 ;
 	    int it = arrayMax(test) ;
@@ -665,15 +669,15 @@ void testMods (Readset *rs, int minDepth, int maxDepth)
 		while (t->mod == m && k < arrayMax(test)) { ++k ; ++t ; }
 		n = k - n ;
 		xmax = (t-1)->dx ;
-		if (n < ms->depth[m] && n*2 < arr(end,xmin,int))
+		if (n < msDepth (ms, m) && n*2 < arr(end,xmin,int))
 		  { ++nMod2 ;
 		    if (RUN > 3) ++rs->modInfo[m].nBadLD ;
 		  }
-		if (n == ms->depth[m] || n >= 0.8*arr(end,xmin,int)) ++nGood ;
+		if (n == msDepth (ms, m) || n >= 0.8*arr(end,xmin,int)) ++nGood ;
 		if (n == 1 && arr(end,xmin,int) >= 10) ++rs->modInfo[i].nBadLD ;
 		fprintf (zFile,
 			 "i %d depth %d m %d depth %d + count %d min %d at %d max %d at %d\n",
-			 i, ms->depth[i], m, ms->depth[m], n,
+			 i, msDepth (ms, i), m, msDepth (ms, m), n,
 			 arr(end,xmin,int), xmin, arr(end,xmax,int), xmax) ;
 	      }
 	    else
@@ -684,19 +688,19 @@ void testMods (Readset *rs, int minDepth, int maxDepth)
 		if (xmin < 0)
 		  { ++nSplit ; ++rs->modInfo[m].nSplitLD ;
 		    xmin = xmax ;
-		    //		    if (RUN > 1) { printf ("SPLIT %d d %d %d d %d x", i, ms->depth[i], m, ms->depth[m]) ; for (kk = k-n ; kk < k ; ++kk) printf (" %d", t[kk-k].dx) ; printf ("\n") ; }
+		    //		    if (RUN > 1) { printf ("SPLIT %d d %d %d d %d x", i, msDepth (ms, i), m, msDepth (ms, m)) ; for (kk = k-n ; kk < k ; ++kk) printf (" %d", t[kk-k].dx) ; printf ("\n") ; }
 		  } // shouldn't happen - repeat?
 		assert (xmin < arrayMax(start)) ;
 		if (xmin < 0) { n = 0 ; xmin = 0 ; }
-		if (n < ms->depth[m] && n*2 < arr(start,xmin,int))
+		if (n < msDepth (ms, m) && n*2 < arr(start,xmin,int))
 		  { ++nMod2 ;
 		    if (RUN > 3) ++rs->modInfo[m].nBadLD ;
 		  }
 		else if (n == 1 && arr(start,xmin,int) >= 10) ++rs->modInfo[m].nBadLD ;
-		if (n == ms->depth[m] || n >= 0.8*arr(start,xmin,int)) ++nGood ;
+		if (n == msDepth (ms, m) || n >= 0.8*arr(start,xmin,int)) ++nGood ;
 		fprintf (zFile,
 			 "i %d depth %d m %d depth %d - count %d min %d at %d max %d at %d\n",
-			 i, ms->depth[i], m, ms->depth[m], n,
+			 i, msDepth (ms, i), m, msDepth (ms, m), n,
 			 arr(start,xmin,int), xmin, arr(start,xmax,int), xmax) ;
 	      }
 	  }
@@ -710,13 +714,13 @@ void testMods (Readset *rs, int minDepth, int maxDepth)
   for (i = 0 ; i < ms->max+1 ; ++i, ++mi)
     { if (mi->nGood || mi->nMod2)
 	fprintf (yFile, "TEST %d depth %d nGood %d nMod2 %d nBadLD %d nSplit %d\n",
-		 i, ms->depth[i], mi->nGood, mi->nMod2, mi->nBadLD, mi->nSplit) ;
+		 i, msDepth (ms, i), mi->nGood, mi->nMod2, mi->nBadLD, mi->nSplit) ;
       if (mi->nGood < mi->nMod2) { msSetCopy0(ms,i) ; ++nZero1 ; }
       if (mi->nSplit > 10) { msSetCopy0(ms,i) ; ++nZero2 ; }
       if (RUN == 2 || RUN == 6)
 	{ if (mi->nBadLD > 20 || mi->nSplitLD > 10)
 	    { fprintf (yFile, "BADLD %d depth %d nBadLD %d nSplitLD %d\n",
-		       i, ms->depth[i], mi->nBadLD, mi->nSplitLD) ;
+		       i, msDepth (ms, i), mi->nBadLD, mi->nSplitLD) ;
 	      msSetCopy0(ms,i) ; ++nZero3 ;
 	    }
 	}
@@ -725,7 +729,7 @@ void testMods (Readset *rs, int minDepth, int maxDepth)
 	  if (mi->nSplit) { msSetCopy0(ms,i) ; ++nZero2 ; }
 	  if (mi->nBadLD > 10)
 	    { fprintf (yFile, "BADLD %d depth %d nBadLD %d nSplitLD %d\n",
-		       i, ms->depth[i], mi->nBadLD, mi->nSplitLD) ;
+		       i, msDepth (ms, i), mi->nBadLD, mi->nSplitLD) ;
 	      msSetCopy0(ms,i) ; ++nZero3 ;
 	    }
 	}
@@ -733,7 +737,7 @@ void testMods (Readset *rs, int minDepth, int maxDepth)
 	{ if (mi->nBadLD > 6)
 	  if (mi->nSplit) { msSetCopy0(ms,i) ; ++nZero2 ; }
 	    { fprintf (yFile, "BADLD %d depth %d nBadLD %d nSplitLD %d\n",
-		       i, ms->depth[i], mi->nBadLD, mi->nSplitLD) ;
+		       i, msDepth (ms, i), mi->nBadLD, mi->nSplitLD) ;
 	      msSetCopy0(ms,i) ; ++nZero3 ;
 	    }
 	}
@@ -759,20 +763,22 @@ void refFlag (Readset *rs, char *filename)
   ModInfo *mi ;
   int *rCount = new0 (ms->max+1, int) ;
 
+  SeqhashBatch *sb = seqhashBatchCreate (1 << 16) ;
   while (seqIOread (si))
-    { SeqhashRCiterator *mit = modRCiterator (ms->hasher, sqioSeq(si), si->seqLen) ;
-      U64 kmer ; int pos ; U32 index ;
-      while (modRCnext (mit, &kmer, &pos, 0))
-	if ((index = modsetIndexFind (ms, kmer, false))) // false for do not add
+    { int n = modRCbatch (ms->hasher, sqioSeq(si), si->seqLen, sb) ;
+      U32 index ;
+      modsetIndexFindBatch (ms, sb, false) ; // false for do not add
+      for (j = 0 ; j < n ; ++j)
+	if ((index = sb->index[j]))
 	  { mi = &(rs->modInfo[index]) ;
 	    msSetRDNA(ms,index) ; 
-	    mi->isRefRDNA = 1 ; mi->rDNApos = pos ;
-	    if (ms->depth[index] > 4750) mi->isMultiRDNA = 1 ;
-	    else if (ms->depth[index] > 2750) mi->isCoreRDNA = 1 ;
+	    mi->isRefRDNA = 1 ; mi->rDNApos = sb->pos[j] ;
+	    if (msDepth (ms, index) > 4750) mi->isMultiRDNA = 1 ;
+	    else if (msDepth (ms, index) > 2750) mi->isCoreRDNA = 1 ;
 	    else mi->isVarRDNA = 1 ;
 	  }
-      seqhashRCiteratorDestroy (mit) ;
     }
+  seqhashBatchDestroy (sb) ;
   seqIOclose (si) ;
 
   int nRDNAreads = 0 ;
@@ -818,8 +824,8 @@ void refFlag (Readset *rs, char *filename)
 		}
 	      else
 		{ msSetRDNA(ms,h) ;
-		  if (ms->depth[h] > 4750) mi->isMultiRDNA = 1 ;
-		  else if (ms->depth[h] > 2750) mi->isCoreRDNA = 1 ;
+		  if (msDepth (ms, h) > 4750) mi->isMultiRDNA = 1 ;
+		  else if (msDepth (ms, h) > 2750) mi->isCoreRDNA = 1 ;
 		  else mi->isVarRDNA = 1 ;
 		  mi->rDNApos = lastPos ;
 		  rCount[h] = 1 ;
@@ -982,10 +988,10 @@ static inline char* modText (Readset *rs, U32 h, bool isReverse)
   if (!(h & TOPBIT)) isReverse = !isReverse ;
   if (mi->isRefRDNA)
     sprintf (buf, "%d %c d %d C%d P %d",
-	     m, isReverse ? 'R' : 'F', (int)rs->ms->depth[m], msCopy(rs->ms,m), mi->rDNApos) ;
+	     m, isReverse ? 'R' : 'F', (int)msDepth (rs->ms, m), msCopy(rs->ms,m), mi->rDNApos) ;
   else
     sprintf (buf, "%d %c d %d C%d p %d",
-	     m, isReverse ? 'R' : 'F', (int)rs->ms->depth[m], msCopy(rs->ms,m), mi->rDNApos) ;
+	     m, isReverse ? 'R' : 'F', (int)msDepth (rs->ms, m), msCopy(rs->ms,m), mi->rDNApos) ;
     
   return buf ;
 }
@@ -1193,11 +1199,12 @@ void assembleFromMod (Readset *rs, U32 seed, int offset)
   Modset *ms = rs->ms ;
   Link *l ;
 
-  printf ("assembling mod %d depth %d\n", seed, ms->depth[seed]) ;
+  printf ("assembling mod %d depth %d\n", seed, msDepth (ms, seed)) ;
   if (!msIsCopy1(ms,seed)) die ("seed copy number %d != 1", msCopy(ms,seed)) ;
 
   Array reads = arrayCreate (1024, U32) ;
-  for (i = 0 ; i < ms->depth[seed] ; ++i) // simple set of reads that contain the seed
+  U32 depth = msDepth (ms, seed) ;
+  for (i = 0 ; i < depth ; ++i) // simple set of reads that contain the seed
     array (reads, arrayMax(reads), U32) = rs->inv[seed][i] ;
   
   // next build an array of all the links seen in the reads
@@ -1463,8 +1470,8 @@ void assembleFromRead (Readset *rs, U32 ix)
       totCount += ah->count ;
       if (!msIsCopy1 (rs->ms, ah->hit)) continue ;
       i = ah->count ; if (i > 19) i = 19 ;
-      j = rs->ms->depth[ah->hit] ; if (j > 19) j = 19 ; ++countA[i][j] ;
-      j = (10*ah->count - 1) / rs->ms->depth[ah->hit] ; ++countB[i][j] ;
+      j = msDepth (rs->ms, ah->hit) ; if (j > 19) j = 19 ; ++countA[i][j] ;
+      j = (10*ah->count - 1) / msDepth (rs->ms, ah->hit) ; ++countB[i][j] ;
     }
   totCount /= hashCount(hitHash) ;
   printf ("AR  %d total hits - mean count %.1f\n", hashCount(hitHash), totCount) ;
@@ -1524,7 +1531,6 @@ int main (int argc, char *argv[])
   if (!argc) usage () ;
 
   int i ;			/* generically useful variables */
-  FILE *f ;
   Modset *ms = 0 ;
   Readset *rs = 0 ;
 
@@ -1556,9 +1562,8 @@ int main (int argc, char *argv[])
 	  }
       }
     else if (ARGMATCH("-m","--modset",2))
-      { if (!(f = fzopen (argv[-1], "r"))) die ("failed to open mod file %s", argv[-1]) ;
-	if (ms) modsetDestroy (ms) ;
-	ms = modsetRead (f) ;
+      { if (ms) modsetDestroy (ms) ;
+	ms = modsetOpen (argv[-1]) ;
 	if (ms->max >= TOPBIT) die ("too many entries in modset") ;
 	modsetSummary (ms, outFile) ;
       }
@@ -1567,7 +1572,6 @@ int main (int argc, char *argv[])
 	  { if (rs) readsetDestroy (rs) ;
 	    rs = readsetCreate (ms, 1<<16) ;
 	    readsetFileRead (rs, argv[-1]) ;
-	    fclose (f) ;
 	  }
 	else fprintf (stderr, "** need to read a modset before a sequence file\n") ;
       }
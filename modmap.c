@@ -27,6 +27,7 @@ struct {
   int w ;
   int s ;
   int B ;
+  int L ;
 } params ;
 
 /*******************************************************************/
@@ -39,7 +40,8 @@ typedef struct {
   U32 *index ; 			/* consecutive Modset index values */
   U32 *offset ;			/* base offset within relevant sequence */
   U32 *id ;			/* index into refDict */
-  U32 *depth ;		  	/* number of times this index is seen; size ms->size */
+  U32 *depth ;		  	/* number of times this index is seen; size depthSize */
+  U32 depthSize ;		/* follows ms->size as the Modset grows */
   U32 *rev ;			/* reverse index from mod to ref; size max */
   U32 *loc ;			/* offsets into rev for each mod ; size ms->max */
   DICT *dict ;			/* set of reference names */
@@ -52,7 +54,8 @@ Reference *referenceCreate (Modset *ms, U32 size)
   if (!size) die ("refCreate must have size > 0") ;
   Reference *ref = new0 (1, Reference) ;
   ref->ms = ms ;
-  ref->depth = ms->max ? new0 (ms->max, U32) : new0 (ms->size, U32) ;
+  ref->depthSize = ms->max ? ms->max+1 : ms->size ;
+  ref->depth = new0 (ref->depthSize, U32) ;
   ref->size = size ;
   ref->index = new (size, U32) ;
   ref->offset = new (size, U32) ;
@@ -73,7 +76,8 @@ void referenceDestroy (Reference *ref)
 
 void referencePack (Reference *ref)
 {
-  resize (ref->depth, ref->ms->size, ref->ms->max+1, U32) ;
+  resize (ref->depth, ref->depthSize, ref->ms->max+1, U32) ;
+  ref->depthSize = ref->ms->max+1 ;
   resize (ref->index, ref->size, ref->max, U32) ;
   resize (ref->offset, ref->size, ref->max, U32) ;
   resize (ref->id, ref->size, ref->max, U32) ;
@@ -84,7 +88,7 @@ void referencePack (Reference *ref)
   int i ;
   for (i = 1 ; i <= ref->ms->max ; ++i)
     { ref->loc[i] = ref->loc[i-1] + ref->depth[i-1] ; }
-  memset (ref->depth, 0, ref->ms->size*sizeof(U32)) ; /* build this up again in loop below */
+  memset (ref->depth, 0, ref->depthSize*sizeof(U32)) ; /* build this up again in loop below */
   U32 *ri = ref->index ;
   for (i = 0 ; i < ref->max ; ++i, ++ri)
     ref->rev[ref->loc[*ri] + ref->depth[*ri]++] = i ;
@@ -94,30 +98,35 @@ void referenceFastaRead (Reference *ref, char *filename, bool isAdd)
 {
   U64 totLen = 0 ;
   
-  dna2indexConv['N'] = dna2indexConv['n'] = 0 ; /* to get 2-bit encoding */
    SeqIO *si = seqIOopenRead (filename, dna2indexConv, false) ;
   if (!si) die ("failed to read reference sequence file %s", filename) ;
+  SeqhashBatch *sb = seqhashBatchCreate (1 << 20) ;
   while (seqIOread (si)) 
     { int id ;
       if (!dictAdd (ref->dict, sqioId(si), &id))
 	die ("duplicate ref sequence name %s", sqioId(si)) ;
       array (ref->len, id, int) = si->seqLen ;
       totLen += si->seqLen ;
-      SeqhashRCiterator *mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
-      U64 kmer ; int pos ;
-      while (modRCnext (mi, &kmer, &pos, 0))
-	{ U32 index = modsetIndexFind (ref->ms, kmer, isAdd) ;
+      int j, n = modRCbatchThreads (ref->ms->hasher, sqioSeq(si), si->seqLen, sb, numThreads) ;
+      modsetIndexFindBatch (ref->ms, sb, isAdd) ;
+      for (j = 0 ; j < n ; ++j)
+	{ U32 index = sb->index[j] ;
 	  if (index)
 	    { if (ref->max+1 >= ref->size) die ("reference size overflow") ;
 	      ref->index[ref->max] = index ;
+	      if (index >= ref->depthSize)
+		{ resize (ref->depth, ref->depthSize, ref->ms->size, U32) ;
+		  memset (ref->depth + ref->depthSize, 0, (ref->ms->size - ref->depthSize)*sizeof(U32)) ;
+		  ref->depthSize = ref->ms->size ;
+		}
 	      ++ref->depth[index] ;
-	      ref->offset[ref->max] = pos ;
+	      ref->offset[ref->max] = sb->pos[j] ;
 	      ref->id[ref->max] = id ;
 	      ++ref->max ;
 	    }
 	}
-      seqhashRCiteratorDestroy (mi) ;
     }
+  seqhashBatchDestroy (sb) ;
   seqIOclose (si) ;
 
   fprintf (outFile, "  %d hashes from %d reference sequences, total length %lld\n",
@@ -136,9 +145,8 @@ void referenceFastaRead (Reference *ref, char *filename, bool isAdd)
 void referenceWrite (Reference *ref, char *root)
 {
   FILE *f ;
-  if (!(f = fopenTag (root, "mod", "w"))) die ("failed to open %s.mod to write", root) ;
-  modsetWrite (ref->ms, f) ;
-  fclose (f) ;
+  char modName[strlen(root)+5] ; sprintf (modName, "%s.mod", root) ;
+  modsetWriteMap (ref->ms, modName) ; /* so concurrent jobs can share it */
   if (!(f = fopenTag (root, "ref", "w"))) die ("failed to open %s.ref to write", root) ;
   if (fwrite ("RFMSHv1",8,1,f) != 1) die ("failed to write reference header") ;
   U32 size = ref->max ; if (fwrite (&size,sizeof(U32),1,f) != 1) die ("failed to write size") ;
@@ -158,9 +166,8 @@ void referenceWrite (Reference *ref, char *root)
 Reference *referenceRead (char *root)
 {
   FILE *f ;
-  if (!(f = fopenTag (root, "mod", "r"))) die ("failed to open %s.mod to read", root) ;
-  Modset *ms = modsetRead (f) ;
-  fclose (f) ;
+  char modName[strlen(root)+5] ; sprintf (modName, "%s.mod", root) ;
+  Modset *ms = modsetOpen (modName) ;
   if (!(f = fopenTag (root, "ref", "r"))) die ("failed to open %s.ref to read", root) ;
   char name[8] ;
   if (fread (name,8,1,f) != 1) die ("failed to read reference header") ;
@@ -190,22 +197,24 @@ void queryProcess (Reference *ref, char *filename)
   int len ;
   Array seeds = 0 ;
 
-  dna2indexConv['N'] = dna2indexConv['n'] = 0 ; /* to get 2-bit encoding */
   SeqIO *si = seqIOopenRead (filename, dna2indexConv, false) ;
   if (!si) die ("failed to read query sequence file %s", filename) ;
+  if (si->type == BINARY) si->isPacked = true ; /* hash directly from the packed sequence */
+  SeqhashBatch *sb = seqhashBatchCreate (1024) ; /* reused for every query */
   while (seqIOread (si)) 
-    { SeqhashRCiterator *mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
-      U64 kmer ; int pos ;
+    { int j, n = si->isPacked ?
+	modRCbatchPacked (ref->ms->hasher, sqioSeqPacked(si), 0, si->seqLen, sb) :
+	modRCbatch (ref->ms->hasher, sqioSeq(si), si->seqLen, sb) ;
       seeds = arrayReCreate (seeds, 1024, Seed) ;
       int missed = 0, copy[4] ; copy[1] = copy[2] = copy[3] = 0 ;
-      while (modRCnext (mi, &kmer, &pos, 0))
-	{ U32 index = modsetIndexFind (ref->ms, kmer, false) ;
+      modsetIndexFindBatch (ref->ms, sb, false) ;
+      for (j = 0 ; j < n ; ++j)
+	{ U32 index = sb->index[j] ;
 	  Seed *s = arrayp(seeds,arrayMax(seeds),Seed) ;
-	  s->index = index ; s->pos = pos ;
+	  s->index = index ; s->pos = sb->pos[j] ;
 	  if (index) ++copy[msCopy(ref->ms,index)] ;
 	  else ++missed ;
 	}
-      seqhashRCiteratorDestroy (mi) ;
       fprintf (outFile, "Q\t%s\t%llu\t%d miss, %d copy1, %d copy2, %d multi, %.2f hit\n",
 	       sqioId(si), si->seqLen, missed, copy[1], copy[2], copy[3],
 	       (arrayMax(seeds)-missed)/(double)(arrayMax(seeds))) ;
@@ -275,6 +284,7 @@ void queryProcess (Reference *ref, char *filename)
 		 n1, n2, (n1+n2) / (double)((locN>loc0) ? (locN-loc0) : (loc0-locN)),
 		 n1 / (double)copy[1]) ;
     }
+  seqhashBatchDestroy (sb) ;
   seqIOclose (si) ;
   
   arrayDestroy (seeds) ;
@@ -288,7 +298,8 @@ void usage (void)
   fprintf (stderr, "  -K | --kmer <kmer size> [%d]\n", params.k) ;
   fprintf (stderr, "  -W | --window <window> [%d]\n", params.w) ;
   fprintf (stderr, "  -S | --seed <random number seed> [%d]\n", params.s) ;
-  fprintf (stderr, "  -B | --tableBits <hash index table bitcount> [%d]\n", params.B) ;
+  fprintf (stderr, "  -B | --tableBits <starting hash index table bitcount - grows as needed> [%d]\n", params.B) ;
+  fprintf (stderr, "  -L | --link <max bases between linked modimizers, 0 for single seeds> [%d]\n", params.L) ;
   fprintf (stderr, "  -v | --verbose : toggle verbose mode\n") ;
   fprintf (stderr, "  -t | --threads <number of threads for parallel ops> [%d]\n", numThreads) ;
   fprintf (stderr, "  -o | --output <output filename> : '-' for stdout\n") ;
@@ -314,7 +325,7 @@ int main (int argc, char *argv[])
   params.k = 19 ;
   params.w = 31 ;
   params.s = 17 ;
-  params.B = 28 ;
+  params.B = 24 ;
 
   if (!argc) usage () ;
 
@@ -335,6 +346,7 @@ int main (int argc, char *argv[])
     else if (ARGMATCH("-W","--window",2)) params.w = atoi(argv[-1]) ;
     else if (ARGMATCH("-S","--seed",2)) params.s = atoi(argv[-1]) ;
     else if (ARGMATCH("-B","--tableBits",2)) params.B = atoi(argv[-1]) ;
+    else if (ARGMATCH("-L","--link",2)) params.L = atoi(argv[-1]) ;
     else if (ARGMATCH("-t","--threads",2))
       {
 #ifdef OMP
@@ -357,8 +369,11 @@ int main (int argc, char *argv[])
     else if (ARGMATCH("-f","--referenceFasta",2))
       { if (params.k <= 0 || params.w <= 0) die ("k %d, w %d must be > 0", params.k, params.w) ;
 	Seqhash *hasher = seqhashCreate (params.k, params.w, params.s) ;
-	fprintf (outFile, "  modmap initialised with k = %d, w = %d, random seed = %d\n",
+	hasher->link = params.L ;
+	fprintf (outFile, "  modmap initialised with k = %d, w = %d, random seed = %d",
 		 params.k, params.w, params.s) ;
+	if (params.L) fprintf (outFile, ", link = %d", params.L) ;
+	fputc ('\n', outFile) ;
 	Modset *ms = modsetCreate (hasher, params.B, 0) ;
 	ref = referenceCreate (ms, 1 << 26) ;
 	referenceFastaRead (ref, argv[-1], true) ;
@@ -14,6 +14,11 @@
 #include "modset.h"
 #include "seqio.h"
 
+#ifdef OMP
+#include <omp.h>
+#endif
+
+int numThreads = 1 ;		/* default to serial - reset if multi-threaded */
 FILE *outFile ;
 bool isVerbose = false ;
 
@@ -27,30 +32,28 @@ typedef struct {
 static Ref* refCreate (char *seqFileName, char *modFileName)
 {
   int i, n = 0 ;
-  FILE *f ;
   Ref *ref = new0 (1, Ref) ;
 
-  if (!(f = fopen (modFileName, "r")))
-    die ("failed to open mod file %s", modFileName) ;
-  if (!(ref->ms = modsetRead (f)))
-    die ("failed to read reference modset from file %s", modFileName) ;
-  fclose (f) ;
+  ref->ms = modsetOpen (modFileName) ;
 
   ref->pos = new0 (ref->ms->max+1, int) ;
   ref->isF = new0 (ref->ms->max+1, bool) ;
   SeqIO *si = seqIOopenRead (seqFileName, dna2indexConv, false) ; /* false for no qualities */
   if (!si) die ("can't open reference sequence file %s", seqFileName) ;
   if (seqIOread (si))
-    { U64 hash, index ; int loc ; bool isF ;
-      SeqhashRCiterator *mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
-      while (modRCnext (mi, &hash, &loc, (bool*)&isF))
-	if ((index = modsetIndexFind (ref->ms, hash, false)))
-	  { if (ref->pos[index]) die ("duplicate mod entry at position %d in ref", loc) ;
+    { U64 index ; int j ;
+      SeqhashBatch *sb = seqhashBatchCreate (si->seqLen) ;
+      int nb = modRCbatchThreads (ref->ms->hasher, sqioSeq(si), si->seqLen, sb, numThreads) ;
+      for (j = 0 ; j < nb ; ++j)
+	if ((index = modsetIndexFindHit (ref->ms, sb, j, false)))
+	  { int loc = sb->pos[j] ;
+	    if (ref->pos[index]) die ("duplicate mod entry at position %d in ref", loc) ;
 	    ref->pos[index] = loc ;
-	    ref->isF[index] = isF ;
+	    ref->isF[index] = sb->isF[j] ;
 	    if (loc >= ref->len) ref->len = loc+1 ;
 	    ++n ;
 	  }
+      seqhashBatchDestroy (sb) ;
     }
   else die ("can't read reference sequence") ;
   if (seqIOread (si)) die ("multiple sequences in ref file - only one allowed") ;
@@ -176,12 +179,7 @@ void analyzeSequences3 (char *seqFileName, char *modFileName, Ref *ref)
   Modset *ms ;
   Array   reads = arrayCreate (12000, Read) ;
 
-  { FILE *f = fopen (modFileName, "r") ;
-    if (!f) die ("failed to open mod file %s", modFileName) ;
-    if (!(ms = modsetRead (f)))
-      die ("failed to read modset from file %s", modFileName) ;
-    fclose (f) ;
-  }
+  ms = modsetOpen (modFileName) ;
 
   Mod *mods = new0 (ms->max, Mod) ;
   
@@ -189,18 +187,18 @@ void analyzeSequences3 (char *seqFileName, char *modFileName, Ref *ref)
   if (!si) die ("can't open sequence file %s", seqFileName) ;
   int nRead = 0, nBad = 0 ;
   bool *isDup = new (ms->max, bool) ;
+  SeqhashBatch *sb = seqhashBatchCreate (1 << 16) ; /* reused for every read */
   while (seqIOread (si))
     { ++nRead ;
-      U64 hash, index ; int loc ; bool isF ;
-      SeqhashRCiterator *mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
+      U64 index ; int b, nb ;
+      nb = modRCbatch (ref->ms->hasher, sqioSeq(si), si->seqLen, sb) ;
       int seqF = 0, seqR = 0, n = 0 ;
-      while (modRCnext (mi, &hash, 0, (bool*)&isF) && n < 100)
-	if ((index = modsetIndexFind (ref->ms, hash, false))) // in reference
-	  { if ((isF && ref->isF[index]) || (!isF && !ref->isF[index])) ++seqF ;
+      for (b = 0 ; b < nb && n < 100 ; ++b)
+	if ((index = modsetIndexFindHit (ref->ms, sb, b, false))) // in reference
+	  { if ((sb->isF[b] && ref->isF[index]) || (!sb->isF[b] && !ref->isF[index])) ++seqF ;
 	    else ++seqR ;
 	    ++n ;
 	  }
-      seqhashRCiteratorDestroy (mi) ;
       if (n < 100 || (seqF > 10 && seqR > 10))
 	{ ++nBad ;
 	  printf ("BADREAD %5d len %5d n %d F %4d R %4d\n",
@@ -215,23 +213,23 @@ void analyzeSequences3 (char *seqFileName, char *modFileName, Ref *ref)
       if (seqF < seqR)		// reverse complement it, in place
 	{ char *s = sqioSeq(si) ;
 	  for (i = 0, j = si->seqLen-1 ; i < j ; ++i, --j)
-	    { char t = 3-s[i] ; s[i] = 3-s[j] ; s[j] = t ; }
-	  if (i == j) s[i] = 3-s[i] ;
+	    { char t = 3^s[i] ; s[i] = 3^s[j] ; s[j] = t ; } // 3^ keeps N > 3
+	  if (i == j) s[i] = 3^s[i] ;
  	}
       else r->isF = true ;
 
-      mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
+      nb = modRCbatch (ref->ms->hasher, sqioSeq(si), si->seqLen, sb) ;
       r->hits = arrayCreate (500, Hit) ;
       bzero (isDup, ms->max) ; // reset array
-      while (modRCnext (mi, &hash, &loc, 0))
-	if ((index = modsetIndexFind (ms, hash, false)))
+      for (b = 0 ; b < nb ; ++b)
+	if ((index = modsetIndexFindHit (ms, sb, b, false)))
 	  { ++mods[index].n ;
 	    if (isDup[index]) ++mods[index].nPre ; else isDup[index] = true ;
 	    h = arrayp(r->hits, arrayMax(r->hits), Hit) ;
-	    h->k = index ; h->x = loc ;
+	    h->k = index ; h->x = sb->pos[b] ;
 	  }
-      seqhashRCiteratorDestroy (mi) ;
     }
+  seqhashBatchDestroy (sb) ;
   free (isDup) ;
   fprintf (stderr, "read %d reads, %d bad, %d good: ", nRead, nBad, arrayMax(reads)) ;
   int nMod = 0, nDup = 0, tDup = 0 ;
@@ -278,30 +276,25 @@ void analyzeSequences1 (char *seqFileName, char *modFileName, Ref *ref)
   Modset *ms ;
   Array   reads = arrayCreate (12000, Read) ;
 
-  { FILE *f = fopen (modFileName, "r") ;
-    if (!f) die ("failed to open mod file %s", modFileName) ;
-    if (!(ms = modsetRead (f)))
-      die ("failed to read modset from file %s", modFileName) ;
-    fclose (f) ;
-  }
+  ms = modsetOpen (modFileName) ;
 
   Mod *mods = new0 (ms->max, Mod) ;
   
   SeqIO *si = seqIOopenRead (seqFileName, dna2indexConv, false) ; /* false for no qualities */
   if (!si) die ("can't open sequence file %s", seqFileName) ;
   int nRead = 0, nBad = 0 ;
+  SeqhashBatch *sb = seqhashBatchCreate (1 << 16) ; /* reused for every read */
   while (seqIOread (si))
     { ++nRead ;
-      U64 hash, index ; int loc ; bool isF ;
-      SeqhashRCiterator *mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
+      U64 index ; int b, nb ;
+      nb = modRCbatch (ref->ms->hasher, sqioSeq(si), si->seqLen, sb) ;
       int seqF = 0, seqR = 0, n = 0 ;
-      while (modRCnext (mi, &hash, 0, (bool*)&isF) && n < 100)
-	if ((index = modsetIndexFind (ref->ms, hash, false))) // in reference
-	  { if ((isF && ref->isF[index]) || (!isF && !ref->isF[index])) ++seqF ;
+      for (b = 0 ; b < nb && n < 100 ; ++b)
+	if ((index = modsetIndexFindHit (ref->ms, sb, b, false))) // in reference
+	  { if ((sb->isF[b] && ref->isF[index]) || (!sb->isF[b] && !ref->isF[index])) ++seqF ;
 	    else ++seqR ;
 	    ++n ;
 	  }
-      seqhashRCiteratorDestroy (mi) ;
       if (n < 100 || (seqF > 10 && seqR > 10))
 	{ ++nBad ;
 //	  printf ("BAD %5d len %5d start %d end %d F %4d R %4d\n",
@@ -311,25 +304,25 @@ void analyzeSequences1 (char *seqFileName, char *modFileName, Ref *ref)
       if (seqF < seqR)		// reverse complement it, in place
 	{ char *s = sqioSeq(si) ;
 	  for (i = 0, j = si->seqLen-1 ; i < j ; ++i, --j)
-	    { char t = 3-s[i] ; s[i] = 3-s[j] ; s[j] = t ; }
-	  if (i == j) s[i] = 3-s[i] ;
+	    { char t = 3^s[i] ; s[i] = 3^s[j] ; s[j] = t ; } // 3^ keeps N > 3
+	  if (i == j) s[i] = 3^s[i] ;
 	}
 
-      mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
+      nb = modRCbatch (ref->ms->hasher, sqioSeq(si), si->seqLen, sb) ;
 #ifdef SEGMENT      
-      while (modRCnext (mi, &hash, &loc, 0) && (loc + 5000 < si->seqLen))
-	if ((index = modsetIndexFind (ref->ms, hash, false)) && index == 1)
-	  { int locEnd = loc + 5000 ;
+      for (b = 0 ; b < nb && (sb->pos[b] + 5000 < si->seqLen) ; ++b)
+	if ((index = modsetIndexFindHit (ref->ms, sb, b, false)) && index == 1)
+	  { int locEnd = sb->pos[b] + 5000 ;
 	    r = arrayp (reads, arrayMax(reads), Read) ;
 	    r->i = nRead-1 ;
-	    r->loc0 = loc ;
+	    r->loc0 = sb->pos[b] ;
 	    r->len = si->seqLen ;
 	    r->hits = arrayCreate (500, Hit) ;
-	    while (modRCnext (mi, &hash, &loc, 0) && (loc < locEnd))
-	      if ((index = modsetIndexFind (ms, hash, false)))
+	    for (++b ; b < nb && (sb->pos[b] < locEnd) ; ++b)
+	      if ((index = modsetIndexFindHit (ms, sb, b, false)))
 		{ ++mods[index].n ;
 		  h = arrayp(r->hits, arrayMax(r->hits), Hit) ;
-		  h->k = index ; h->x = loc - r->loc0 ;
+		  h->k = index ; h->x = sb->pos[b] - r->loc0 ;
 		}
 	  }
 #else 
@@ -338,15 +331,15 @@ void analyzeSequences1 (char *seqFileName, char *modFileName, Ref *ref)
       r->loc0 = 0 ;
       r->len = si->seqLen ;
       r->hits = arrayCreate (500, Hit) ;
-      while (modRCnext (mi, &hash, &loc, 0))
-	if ((index = modsetIndexFind (ms, hash, false)))
+      for (b = 0 ; b < nb ; ++b)
+	if ((index = modsetIndexFindHit (ms, sb, b, false)))
 	  { ++mods[index].n ;
 	    h = arrayp(r->hits, arrayMax(r->hits), Hit) ;
-	    h->k = index ; h->x = loc ;
+	    h->k = index ; h->x = sb->pos[b] ;
 	  }
 #endif      
-      seqhashRCiteratorDestroy (mi) ;
     }
+  seqhashBatchDestroy (sb) ;
 
   fprintf (stderr, "read %d reads, %d bad, %d good: ", nRead, nBad, arrayMax(reads)) ;
   timeUpdate (stderr) ;
@@ -501,28 +494,24 @@ void analyzeSequences2 (char *seqFileName, char *modFileName, Ref *ref)
   Modset *ms ;
   Array   reads = arrayCreate (12000, Read) ;
 
-  { FILE *f = fopen (modFileName, "r") ;
-    if (!f) die ("failed to open mod file %s", modFileName) ;
-    if (!(ms = modsetRead (f)))
-      die ("failed to read modset from file %s", modFileName) ;
-    fclose (f) ;
-  }
+  ms = modsetOpen (modFileName) ;
   Mod *mods = new0 (ms->max, Mod) ;
   U64 *hits = new (ms->max, U64) ;
 
   //  for (i = 0 ; i < ref->ms->max ; ++i)
   //    if ((j = modsetIndexFind (ms, ref->ms->value[i], false)))
-  //      printf ("REF %4d pos %5d depth %5d\n", i, ref->pos[i], ms->depth[j]) ;
+  //      printf ("REF %4d pos %5d depth %5d\n", i, ref->pos[i], msDepth (ms, j)) ;
 
   SeqIO *si = seqIOopenRead (seqFileName, dna2indexConv, false) ; /* false for no qualities */
   if (!si) die ("can't open sequence file %s", seqFileName) ;
   int n1 = 0, n2 = 0, n3 = 0, n4 = 0 ;
+  SeqhashBatch *sb = seqhashBatchCreate (1 << 16) ;
   while (seqIOread (si))
-    { SeqhashRCiterator *mi = modRCiterator (ref->ms->hasher, sqioSeq(si), si->seqLen) ;
-      U64 hash, index ; int loc ; bool isF ;
+    { int b, nb = modRCbatch (ref->ms->hasher, sqioSeq(si), si->seqLen, sb) ;
+      U64 index ;
       bool is0 = false, is1 = false, is2 = false, is3 = false ;
-      while (modRCnext (mi, &hash, &loc, (bool*)&isF))
-	if ((index = modsetIndexFind (ref->ms, hash, false))) // in reference
+      for (b = 0 ; b < nb ; ++b)
+	if ((index = modsetIndexFindHit (ref->ms, sb, b, false))) // in reference
 	  { if (index == boundary[0]) is0 = true ;
 	    else if (index == boundary[1]) is1 = true ;
 	    else if (index == boundary[2]) is2 = true ;
@@ -533,6 +522,7 @@ void analyzeSequences2 (char *seqFileName, char *modFileName, Ref *ref)
       if (is2 && is3) ++n3 ;
       if (is3 && is0) ++n4 ;
     }
+  seqhashBatchDestroy (sb) ;
   printf ("n1 %d n2 %d n3 %d n4 %d\n", n1, n2, n3, n4) ;
   
   modsetDestroy (ms) ;
@@ -542,6 +532,7 @@ void usage (void)
 { fprintf (stderr, "Usage: modrep <commands>\n") ;
   fprintf (stderr, "Commands are executed in order - set parameters before using them!\n") ;
   fprintf (stderr, "  -v | --verbose : toggle verbose mode\n") ;
+  fprintf (stderr, "  -t | --threads <number of threads for parallel ops> [%d]\n", numThreads) ;
   fprintf (stderr, "  -o | --output <output_filename> : '-' for stdout\n") ;
   fprintf (stderr, "  -R | --ref <seq_file> <mod_file>\n") ;
   fprintf (stderr, "  -s1 | --seq1 <seq_file> <mod_file>: analyse reads\n") ;
@@ -556,7 +547,10 @@ int main (int argc, char *argv[])
 
   outFile = stdout ;
   timeUpdate (stdout) ;		/* initialise timer */
-  dna2indexConv['N'] = dna2indexConv['n'] = 0 ; /* to get 2-bit encoding */
+#ifdef OMP
+  numThreads = omp_get_max_threads () ;
+  omp_set_num_threads (numThreads) ;
+#endif
 
   int i ;			/* generically useful variables */
   FILE *f ;
@@ -571,6 +565,16 @@ int main (int argc, char *argv[])
       
 #define ARGMATCH(x,y,n)	((!strcmp (*argv, x) || (!strcmp (*argv,y))) && argc >= n && (argc -= n, argv += n))
       if (ARGMATCH("-v","--verbose",1)) isVerbose = !isVerbose ;
+      else if (ARGMATCH("-t","--threads",2))
+	{
+#ifdef OMP
+	  numThreads = atoi(argv[-1]) ;
+	  if (numThreads > omp_get_max_threads ()) numThreads = omp_get_max_threads () ;
+	  omp_set_num_threads (numThreads) ;
+#else
+	  fprintf (stderr, "  can't set thread number - not compiled with OMP\n") ;
+#endif
+	}
       else if (ARGMATCH("-o","--output",2))
 	{ if (!strcmp (argv[-1], "-"))
 	    outFile = stdout ;
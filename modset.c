@@ -3,6 +3,7 @@
  *  Copyright (C) Richard Durbin, Cambridge University, 2018
  *-------------------------------------------------------------------
  * Description: package to handle sets of "mod" sequence hashes
+	compile with -DTEST to build a self-checking test main() at the end
  * Exported functions:
  * HISTORY:
  * Last edited: Aug 14 01:52 2020 (rd109)
@@ -11,145 +12,1655 @@
  */
 
 #include "modset.h"
+#include <stddef.h>		/* offsetof() */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
   
+/* The index is a table of 64 byte buckets, each with nSlot slots packed into MS_BUCKET_BITS,
+   so a find usually touches one cache line.  Kmers are not stored in full.  The key of a kmer,
+   its 2k bits, or the low 64 bits for k > 31 or linked seeds, goes through an invertible mix,
+   the top bits of which give its home bucket, and a slot only holds the remBits below those,
+   with the index and the displacement from the home bucket, which is at most MS_DISP_MAX.
+   So the kmer in a slot is recovered by putting its home back on top and unmixing - see
+   modsetSlot().  For k > 31 the high 64 bits are in valueHi, and a match is checked there.
+   Entries go in their home bucket if there is space, else on into the following ones, with
+   Robin Hood ordering: the slots in a run are kept sorted by home bucket, so a search for an
+   absent kmer can stop at the first entry from a later home.  This keeps displacements short,
+   and finds fast, at high occupancy - see modsetMaxSize().  There are tableSize/16 buckets.
+   When the number of entries would pass ms->load of the slots, or a displacement would pass
+   MS_DISP_MAX, the table doubles, and the entries are moved over from the old buckets.  The
+   per-entry arrays grow separately, doubling as needed up to that limit.
+*/
+
+#define MS_DISP_BITS 6
+#define MS_DISP_MAX ((1 << MS_DISP_BITS) - 1)
+
+#define MS_MIX1 0x9e3779b97f4a7c15ULL	/* odd, so invertible mod 2^keyBits */
+#define MS_MIX2 0xbf58476d1ce4e5b9ULL
+#define MS_UNMIX1 0xf1de83e19937733dULL	/* their inverses mod 2^64 */
+#define MS_UNMIX2 0x96de1b173f119089ULL
+
+/* x -> x ^ (x >> mixShift) is its own inverse as mixShift >= keyBits/2, so this is a bijection
+   on keyBits bits whose top bits depend on all of them
+*/
+static inline U64 keyMix (Modset *ms, U64 x)
+{ x = (x * MS_MIX1) & ms->keyMask ; x ^= x >> ms->mixShift ; return (x * MS_MIX2) & ms->keyMask ; }
+static inline U64 keyUnmix (Modset *ms, U64 x)
+{ x = (x * MS_UNMIX2) & ms->keyMask ; x ^= x >> ms->mixShift ; return (x * MS_UNMIX1) & ms->keyMask ; }
+
+static inline U64 mixHome (Modset *ms, U64 m) { return (m >> ms->remBits) << ms->homeUp ; }
+static inline U64 mixRem (Modset *ms, U64 m) { return m & (((U64)1 << ms->remBits) - 1) ; }
+
+static inline U64 msBits (U64 *a, U64 off, int bits) /* bits < 64 bits from bit off of a */
+{ U64 x = a[off >> 6] >> (off & 0x3f) ;
+  if ((off & 0x3f) + bits > 64) x |= a[(off >> 6) + 1] << (64 - (off & 0x3f)) ;
+  return x & (((U64)1 << bits) - 1) ;
+}
+static inline void msBitsSet (U64 *a, U64 off, int bits, U64 x)
+{ U64 *w = a + (off >> 6), m = ((U64)1 << bits) - 1 ;
+  int s = off & 0x3f ;
+  w[0] = (w[0] & ~(m << s)) | (x << s) ;
+  if (s + bits > 64) w[1] = (w[1] & ~(m >> (64 - s))) | (x >> (64 - s)) ;
+}
+
+/* a slot is its index in the low indexBits, then the tag: displacement below remainder */
+static inline U32 slotIndex (Modset *ms, MsBucket *bu, int j)
+{ return msBits (bu->word, j * ms->slotBits, ms->indexBits) ; }
+static inline U64 slotTag (Modset *ms, MsBucket *bu, int j)
+{ return msBits (bu->word, j * ms->slotBits + ms->indexBits, ms->slotBits - ms->indexBits) ; }
+static inline void slotSet (Modset *ms, MsBucket *bu, int j, U32 index, U64 tag)
+{ msBitsSet (bu->word, j * ms->slotBits, ms->indexBits, index) ;
+  msBitsSet (bu->word, j * ms->slotBits + ms->indexBits, ms->slotBits - ms->indexBits, tag) ;
+}
+static inline MsBucket *slotBucket (Modset *ms, U64 p) { return &ms->bucket[p / ms->nSlot] ; }
+
+static inline MsBucket *bucketCreate (U64 n)
+{ MsBucket *b = (MsBucket*) aligned_alloc (64, n*sizeof(MsBucket)) ;
+  if (!b) die ("failed to allocate %llu Modset buckets", n) ;
+  memset (b, 0, n*sizeof(MsBucket)) ;
+  return b ;
+}
+
+static void tableSet (Modset *ms, int bits) /* the sizes and slot layout derived from tableBits */
+{
+  Seqhash *sh = ms->hasher ;
+  ms->tableBits = bits ;
+  ms->tableSize = (U64)1 << ms->tableBits ;
+  ms->nBucket = ms->tableSize >> 4 ;
+  ms->bucketMask = ms->nBucket - 1 ;
+  int bucketBits = bits - 4 ;
+  ms->keyBits = (seqhashIsLong (sh) || sh->link) ? 64 : 2 * sh->k ;
+  ms->keyMask = (ms->keyBits == 64) ? U64MAX : ((U64)1 << ms->keyBits) - 1 ;
+  ms->mixShift = (ms->keyBits + 1) / 2 ;
+  ms->remBits = (ms->keyBits > bucketBits) ? ms->keyBits - bucketBits : 0 ;
+  ms->homeUp = (ms->keyBits < bucketBits) ? bucketBits - ms->keyBits : 0 ; /* only tiny k */
+  for (ms->indexBits = (bits < 32) ? bits : 32 ; ; ++ms->indexBits)
+    { ms->slotBits = ms->indexBits + MS_DISP_BITS + ms->remBits ;
+      ms->nSlot = MS_BUCKET_BITS / ms->slotBits ;
+      if (ms->indexBits == 32 || ms->nBucket * ms->nSlot <= ((U64)1 << ms->indexBits)) break ;
+    }
+}
+
+U32 modsetMaxSize (Seqhash *sh, int bits, double load)
+{ Modset m ; m.hasher = sh ; tableSet (&m, bits) ;
+  U64 size = load * m.nSlot * m.nBucket ;
+  return size > U32MAX ? U32MAX - 1 : size - 1 ; /* U32MAX is kept out of the index range */
+}
+
 Modset *modsetCreate (Seqhash *sh, int bits, U32 size)
 {
   if (bits < 20 || bits > 34) die ("table bits %d must be between 20 and 34", bits) ;
   Modset *ms = new0 (1, Modset) ;
   ms->hasher = sh ;
-  ms->tableBits = bits ;
-  ms->tableSize = (U64)1 << ms->tableBits ;
-  ms->tableMask = ms->tableSize - 1 ;
-  ms->index = new0 (ms->tableSize, U32) ;
-  if (size >= (ms->tableSize >> 2)) die ("Modset size %u is too big for %d bits", size, bits) ;
+  tableSet (ms, bits) ;
+  ms->bucket = bucketCreate (ms->nBucket) ;
+  ms->load = MS_LOAD_DEFAULT ;
+  if (size > modsetMaxSize (sh, bits, MS_LOAD_MAX)) die ("Modset size %u is too big for %d bits", size, bits) ;
   else if (size) ms->size = size ;
-  else ms->size = (ms->tableSize >> 2) - 1 ;
-  ms->value = new (ms->size, U64) ;
-  ms->depth = new0 (ms->size, U16) ;
+  else
+    { ms->size = modsetMaxSize (sh, bits, ms->load) ;
+      if (ms->size > MS_SIZE_START) ms->size = MS_SIZE_START ;
+    }
+  if (seqhashIsLong (sh)) ms->valueHi = new0 (ms->size, U64) ; /* new0 since [0] is written */
+  ms->depth = new0 (ms->size, U8) ;
   ms->info = new0 (ms->size, U8) ;
   return ms ;
 }
 
 void modsetDestroy (Modset *ms)
-{ free (ms->index) ; free (ms->value) ; free (ms->info) ; free (ms) ; }
+{ if (ms->map) munmap (ms->map, ms->mapSize) ;
+  else
+    { free (ms->bucket) ; free (ms->valueHi) ; free (ms->depth) ; free (ms->info) ;
+      free (ms->sampleDepth) ;
+    }
+  if (ms->depthHash) { hashDestroy (ms->depthHash) ; arrayDestroy (ms->depthBig) ; }
+  free (ms) ;
+}
 
 bool modsetPack (Modset *ms)	/* compress per-item arrays */
 { if (ms->size == ms->max+1) return false ;
-  resize (ms->value, ms->size, ms->max+1, U64) ;
-  resize (ms->depth, ms->size, ms->max+1, U16) ;
+  if (ms->valueHi) resize (ms->valueHi, ms->size, ms->max+1, U64) ;
+  resize (ms->depth, ms->size, ms->max+1, U8) ;
   resize (ms->info, ms->size, ms->max+1, U8) ;
+  if (ms->nSample)
+    resize (ms->sampleDepth, (U64)ms->size*ms->nSample, (U64)(ms->max+1)*ms->nSample, U16) ;
   ms->size = ms->max+1 ;
   return true ;
 }
 
+U32 modsetSlot (Modset *ms, U64 p, U128 *kmer)
+{
+  MsBucket *bu = slotBucket (ms, p) ;
+  int j = p % ms->nSlot ;
+  U32 i = slotIndex (ms, bu, j) ;
+  if (!i || !kmer) return i ;
+  U64 t = slotTag (ms, bu, j), home = (p / ms->nSlot - (t & MS_DISP_MAX)) & ms->bucketMask ;
+  U64 lo = keyUnmix (ms, ((home >> ms->homeUp) << ms->remBits) | (t >> MS_DISP_BITS)) ;
+  *kmer = ms->valueHi ? ((U128)ms->valueHi[i] << 64) | lo : lo ;
+  return i ;
+}
+
+U64 *modsetValues (Modset *ms)
+{
+  U64 p, nSlot = modsetSlots (ms), *value = new0 (ms->max + 1, U64) ;
+  U128 kmer ;
+  for (p = 0 ; p < nSlot ; ++p)
+    { U32 i = modsetSlot (ms, p, &kmer) ; if (i) value[i] = (U64) kmer ; }
+  return value ;
+}
+
+/* Look in bucket b, which is d after the home, for the entry with this tag, which includes d.
+   Returns 1 if found, setting *index, 0 if absent, setting *j to the slot where it should go,
+   or -1 to go on to the next bucket.  Entries from later homes have smaller displacements.
+*/
+
+static inline int bucketScan (Modset *ms, U64 b, U64 d, U64 tag, U64 hi, U32 *index, int *j)
+{
+  MsBucket *bu = &ms->bucket[b] ;
+  for (*j = 0 ; *j < ms->nSlot ; ++*j)
+    { U32 i = slotIndex (ms, bu, *j) ;
+      if (!i) return 0 ;
+      U64 t = slotTag (ms, bu, *j) ;
+      if ((t & MS_DISP_MAX) < d) return 0 ; /* first, since tag is wrong if d > MS_DISP_MAX */
+      if (t == tag && (!ms->valueHi || (i < ms->size && ms->valueHi[i] == hi))) /* i may be torn */
+	{ *index = i ; return 1 ; }
+    }
+  return -1 ;
+}
+
+/* Sets *pos to the slot of lo,hi, or where it should go, and *tag to the tag for it there, or
+   U64MAX if that would be too far from home, in which case the table must grow to add it.
+*/
+
+static inline bool slotFind (Modset *ms, U64 lo, U64 hi, U64 *pos, U64 *tag, U32 *index)
+{
+  U64 m = keyMix (ms, lo), b = mixHome (ms, m), rem = mixRem (ms, m) << MS_DISP_BITS, d = 0 ;
+  int j, r ;
+  while ((r = bucketScan (ms, b, d, rem | d, hi, index, &j)) < 0) { b = (b + 1) & ms->bucketMask ; ++d ; }
+  *pos = b * ms->nSlot + j ;
+  *tag = (d <= MS_DISP_MAX) ? rem | d : U64MAX ;
+  return r ;
+}
+
+static inline void slotNew (Modset *ms, U64 lo, U64 *pos, U64 *tag) /* slotFind() for a new kmer */
+{
+  U64 m = keyMix (ms, lo), b = mixHome (ms, m), rem = mixRem (ms, m) << MS_DISP_BITS, d = 0 ;
+  int j ;
+  for ( ; ; b = (b + 1) & ms->bucketMask, ++d)
+    { MsBucket *bu = &ms->bucket[b] ;
+      for (j = 0 ; j < ms->nSlot ; ++j)
+	if (!slotIndex (ms, bu, j) || (slotTag (ms, bu, j) & MS_DISP_MAX) < d)
+	  { *pos = b * ms->nSlot + j ;
+	    *tag = (d <= MS_DISP_MAX) ? rem | d : U64MAX ;
+	    return ;
+	  }
+    }
+}
+
+/* Put tag,index in slot pos, first moving the entries from there up to the next empty slot
+   up by one, which adds one to the displacement of those moving into the next bucket.
+   Returns false, changing nothing, if that would pass MS_DISP_MAX.  Bucket versions are odd
+   while this happens, for modsetIndexFindAtomic().
+*/
+
+static void bucketVersionBump (Modset *ms, U64 b0, U64 b1, int order)
+{ U64 b ;			/* the version is the top 32 bits of word[7] */
+  for (b = b0 ; ; b = (b + 1) & ms->bucketMask)
+    { __atomic_store_n (&ms->bucket[b].word[7], ms->bucket[b].word[7] + ((U64)1 << 32), order) ;
+      if (b == b1) break ;
+    }
+}
+
+static inline U32 bucketVersion (MsBucket *bu, int order)
+{ return __atomic_load_n (&bu->word[7], order) >> 32 ; }
+
+static bool slotInsert (Modset *ms, U64 pos, U64 tag, U32 index)
+{
+  U64 n = modsetSlots (ms), e = pos ;
+  if (tag == U64MAX) return false ;
+  while (slotIndex (ms, slotBucket (ms, e), e % ms->nSlot))
+    { if (e % ms->nSlot == ms->nSlot-1 && (slotTag (ms, slotBucket (ms, e), ms->nSlot-1) & MS_DISP_MAX) == MS_DISP_MAX)
+	return false ;
+      if (++e == n) e = 0 ;
+    }
+  bucketVersionBump (ms, pos / ms->nSlot, e / ms->nSlot, __ATOMIC_RELAXED) ;
+  __atomic_thread_fence (__ATOMIC_RELEASE) ;
+  U64 f = e ;
+  while (f != pos)
+    { U64 q = f ? f-1 : n-1 ;
+      MsBucket *bq = slotBucket (ms, q) ;
+      int jq = q % ms->nSlot ;
+      slotSet (ms, slotBucket (ms, f), f % ms->nSlot, slotIndex (ms, bq, jq),
+	       slotTag (ms, bq, jq) + (f % ms->nSlot == 0)) ; /* moved on a bucket */
+      f = q ;
+    }
+  slotSet (ms, slotBucket (ms, pos), pos % ms->nSlot, index, tag) ;
+  bucketVersionBump (ms, pos / ms->nSlot, e / ms->nSlot, __ATOMIC_RELEASE) ;
+  return true ;
+}
+
+static inline bool slotAdd (Modset *ms, U64 lo, U32 index) /* a new kmer - false if it won't fit */
+{ U64 pos, tag ; slotNew (ms, lo, &pos, &tag) ; return slotInsert (ms, pos, tag, index) ; }
+
+/* Move the entries into a new table of 2^bits, or more if displacements overflow there, with
+   the index of entry i changed to newIndex[i], dropping it if that is 0, unless newIndex is 0.
+   The old buckets are read in order, so this mostly adds at the ends of runs.
+*/
+
+static void tableRebuild (Modset *ms, int bits, U32 *newIndex)
+{
+  if (ms->map) modsetUnmap (ms) ;
+  Modset old = *ms ;
+  U64 p, nOld = modsetSlots (&old) ;
+  U128 kmer ;
+  while (true)
+    { tableSet (ms, bits) ;
+      ms->bucket = bucketCreate (ms->nBucket) ;
+      for (p = 0 ; p < nOld ; ++p)
+	{ U32 i = modsetSlot (&old, p, &kmer) ;
+	  if (i && newIndex) i = newIndex[i] ;
+	  if (i && !slotAdd (ms, (U64) kmer, i)) break ;
+	}
+      if (p == nOld) break ;
+      free (ms->bucket) ;
+      if (++bits > 34) die ("Modset displacements overflow at 34 bits") ;
+    }
+  free (old.bucket) ;
+}
+
+static void slotAddGrow (Modset *ms, U64 lo, U32 index) /* slotAdd(), growing if needed */
+{ while (!slotAdd (ms, lo, index))
+    { if (ms->tableBits == 34) die ("Modset displacements overflow at 34 bits") ;
+      tableRebuild (ms, ms->tableBits + 1, 0) ;
+    }
+}
+
+void modsetReserve (Modset *ms, U64 n)
+{
+  U64 need = (U64)ms->max + 1 + n ;
+  if (ms->map && (need > ms->size || need > modsetMaxSize (ms->hasher, ms->tableBits, ms->load)))
+    modsetUnmap (ms) ;
+  if (need > modsetMaxSize (ms->hasher, ms->tableBits, ms->load))
+    { int bits = ms->tableBits ;
+      while (need > modsetMaxSize (ms->hasher, bits, ms->load))
+	if (++bits > 34) die ("Modset can't hold %llu entries", need) ;
+      tableRebuild (ms, bits, 0) ;
+    }
+  if (need > ms->size)
+    { U64 size = 2 * (U64)ms->size, max = modsetMaxSize (ms->hasher, ms->tableBits, ms->load) ;
+      if (size < need) size = need ;
+      if (size > max) size = max ;
+      if (ms->valueHi) resize (ms->valueHi, ms->size, size, U64) ;
+      resize (ms->depth, ms->size, size, U8) ;
+      memset (ms->depth + ms->size, 0, size - ms->size) ;
+      resize (ms->info, ms->size, size, U8) ;
+      memset (ms->info + ms->size, 0, size - ms->size) ;
+      if (ms->nSample)
+	{ resize (ms->sampleDepth, (U64)ms->size*ms->nSample, size*ms->nSample, U16) ;
+	  memset (msSample (ms, ms->size), 0, (size - ms->size)*ms->nSample*sizeof(U16)) ;
+	}
+      ms->size = size ;
+    }
+}
+
+void modsetLoad (Modset *ms, double load)
+{
+  if (load <= 0 || load > MS_LOAD_MAX) die ("bad modset load %g", load) ;
+  ms->load = load ;
+  U32 max = modsetMaxSize (ms->hasher, ms->tableBits, load) ;
+  if ((U64)ms->max + 1 > max) modsetReserve (ms, 0) ;
+  else if (ms->size > max) ms->size = max ; /* so adding grows the table at this load */
+}
+
+void modsetSamples (Modset *ms, int nSample)
+{
+  if (nSample <= ms->nSample) return ;
+  if (nSample > U16MAX) die ("too many samples %d", nSample) ;
+  modsetUnmap (ms) ;
+  U16 *sd = new0 ((U64)ms->size*nSample, U16) ;
+  U32 i ;
+  if (ms->nSample)
+    for (i = 0 ; i <= ms->max ; ++i)
+      memcpy (sd + (U64)i*nSample, msSample (ms, i), ms->nSample*sizeof(U16)) ;
+  free (ms->sampleDepth) ;
+  ms->sampleDepth = sd ;
+  ms->nSample = nSample ;
+}
+
+static inline U32 indexFind (Modset *ms, U64 lo, U64 hi, int isAdd)
+{
+  U64 pos, tag ;
+  U32 index ;
+  if (slotFind (ms, lo, hi, &pos, &tag, &index)) return index ;
+  if (!isAdd) return 0 ;
+  if (ms->max + 1 >= ms->size)	/* grow, and place it again since the table may be new */
+    { modsetReserve (ms, 1) ; slotNew (ms, lo, &pos, &tag) ; }
+  index = ++ms->max ;
+  if (ms->valueHi) ms->valueHi[index] = hi ;
+  while (!slotInsert (ms, pos, tag, index)) /* too far from home, so grow */
+    { if (ms->tableBits == 34) die ("Modset displacements overflow at 34 bits") ;
+      tableRebuild (ms, ms->tableBits + 1, 0) ;
+      slotNew (ms, lo, &pos, &tag) ;
+    }
+  return index ;
+}
+
 U32 modsetIndexFind (Modset *ms, U64 kmer, int isAdd)
+{ return indexFind (ms, kmer, 0, isAdd) ; }
+
+/* as above for kmers with k > 31, which need both the slot and valueHi to match */
+
+U32 modsetIndexFindLong (Modset *ms, U128 kmer, int isAdd)
 {
-  U64 diff = 0 ;
-  U64 hash = seqhash (ms->hasher, kmer) ;
-  U64 offset = hash & ms->tableMask ;
-  U32 index = ms->index[offset] ;
-  while (index && (ms->value[index] != kmer))
-    { if (!diff) diff = ((hash >> ms->tableBits) & ms->tableMask) | 1 ; /* odd so comprime */
-      offset = (offset + diff) & ms->tableMask ;
-      index = ms->index[offset] ;
+  if (!ms->valueHi) return modsetIndexFind (ms, (U64)kmer, isAdd) ;
+  return indexFind (ms, (U64)kmer, (U64)(kmer >> 64), isAdd) ;
+}
+
+/* Each find is usually one cache miss, so we can do much better on a batch of hits by
+   prefetching the home bucket MS_PREFETCH hits ahead of the one being found.  Finds and adds
+   are in order, so the indices are the same as from modsetIndexFindHit().
+*/
+
+#define MS_PREFETCH 16
+
+static inline MsBucket *bucketHome (Modset *ms, U64 lo)
+{ return &ms->bucket[mixHome (ms, keyMix (ms, lo))] ; }
+
+void modsetIndexFindBatch (Modset *ms, SeqhashBatch *sb, int isAdd)
+{
+  int i, n = sb->n ;
+  for (i = 0 ; i < n && i < MS_PREFETCH ; ++i)
+    __builtin_prefetch (bucketHome (ms, sb->kmer[i])) ;
+  for (i = 0 ; i < n ; ++i)
+    { if (i + MS_PREFETCH < n)
+	__builtin_prefetch (bucketHome (ms, sb->kmer[i + MS_PREFETCH])) ;
+      sb->index[i] = indexFind (ms, sb->kmer[i], ms->valueHi ? sb->kmerHi[i] : 0, isAdd) ;
     }
-  if (!index && isAdd)
-    { index = ms->index[offset] = ++ms->max ;
-      if (ms->max >= ms->size) die ("hashTableSize %u is too small for %u", ms->size, ms->max) ;
-      ms->value[index] = kmer ;
+}
+
+/* Thread-safe version, for counting in parallel.  Finds are lock-free: each bucket is read
+   between two loads of its version, and if that was odd or changed the find starts again.
+   Adding takes ms->lock, and then finds again, since another thread may have added the same
+   kmer.  Once entries are in, most calls only find, so the lock is rarely contended.  The
+   result is a normal Modset, apart from the order of the entries, but don't mix this with
+   modsetIndexFind() in parallel.  The Modset can't grow here, so first modsetReserve() room
+   for as many new entries as the parallel section might add.
+*/
+
+static inline void msLock (Modset *ms)
+{ while (__atomic_exchange_n (&ms->lock, 1, __ATOMIC_ACQUIRE)) ; }
+static inline void msUnlock (Modset *ms)
+{ __atomic_store_n (&ms->lock, 0, __ATOMIC_RELEASE) ; }
+
+static bool slotFindAtomic (Modset *ms, U64 lo, U64 hi, U32 *index)
+{
+  U64 m = keyMix (ms, lo), rem = mixRem (ms, m) << MS_DISP_BITS ;
+  while (true)
+    { U64 b = mixHome (ms, m), d = 0 ;
+      while (true)
+	{ MsBucket *bu = &ms->bucket[b] ;
+	  U32 v = bucketVersion (bu, __ATOMIC_ACQUIRE) ;
+	  int j, r = bucketScan (ms, b, d, rem | d, hi, index, &j) ;
+	  __atomic_thread_fence (__ATOMIC_ACQUIRE) ;
+	  if ((v & 1) || bucketVersion (bu, __ATOMIC_RELAXED) != v) break ;
+	  if (r >= 0) return r ;
+	  b = (b + 1) & ms->bucketMask ; ++d ;
+	}
+    }
+}
+
+U32 modsetIndexFindAtomic (Modset *ms, U128 kmer, int isAdd)
+{
+  U64 lo = (U64)kmer, hi = (U64)(kmer >> 64), pos, tag ;
+  U32 index ;
+  if (slotFindAtomic (ms, lo, hi, &index)) return index ;
+  if (!isAdd) return 0 ;
+  msLock (ms) ;
+  if (!slotFind (ms, lo, hi, &pos, &tag, &index)) /* no other thread can change the buckets now */
+    { index = ms->max + 1 ;
+      if (index >= ms->size) die ("Modset size %u too small - modsetReserve() before adding in parallel", ms->size) ;
+      if (ms->valueHi) ms->valueHi[index] = hi ;
+      if (!slotInsert (ms, pos, tag, index)) die ("Modset displacements overflow adding in parallel") ;
+      ms->max = index ;
     }
+  msUnlock (ms) ;
   return index ;
 }
 
-void modsetDepthPrune (Modset *ms, int min, int max)
+/* Depths of MS_DEPTH_BIG and over are in ms->depthBig, at the place given by hashing the index
+   in ms->depthHash.  These are rare, so the U8 ms->depth[] saves a byte per entry over U16,
+   and the lock, needed because HASH is not thread-safe, is rarely taken.  Entries left in the
+   hash when a depth drops back below MS_DEPTH_BIG, e.g. by pruning, are ignored.
+*/
+
+static U32 *depthBigFind (Modset *ms, U32 i, bool isAdd) /* call with ms->lock held */
 {
-  U32 i ;
-  U32 N = ms->max ; ms->max = 0 ;
-  memset (ms->index, 0, ms->tableSize*sizeof(U32)) ;
+  HASHKEY k ; k.i = (long int) i ^ INT_MAX ; /* as HASH_INT() but without its static */
+  int j ;
+  if (!ms->depthHash)
+    { ms->depthHash = hashCreate (1024) ;
+      ms->depthBig = arrayCreate (1024, U32) ;
+    }
+  if (isAdd) hashAdd (ms->depthHash, k, &j) ;
+  else if (!hashFind (ms->depthHash, k, &j)) die ("Modset entry %u has no big depth", i) ;
+  return arrayp(ms->depthBig, j, U32) ;
+}
+
+U32 msDepthBig (Modset *ms, U32 i)
+{ msLock (ms) ; U32 d = *depthBigFind (ms, i, false) ; msUnlock (ms) ; return d ; }
+
+void msDepthSetBig (Modset *ms, U32 i, U32 d)
+{ msLock (ms) ; *depthBigFind (ms, i, true) = d ; ms->depth[i] = MS_DEPTH_BIG ; msUnlock (ms) ; }
+
+void msDepthAddAtomicBig (Modset *ms, U32 i) /* when depth[i] >= MS_DEPTH_BIG-1 */
+{ msLock (ms) ;
+  U32 *d = depthBigFind (ms, i, true) ;
+  if (ms->depth[i] < MS_DEPTH_BIG) { *d = MS_DEPTH_BIG ; ms->depth[i] = MS_DEPTH_BIG ; }
+  else if (*d < U32MAX) ++*d ;
+  msUnlock (ms) ;
+}
+
+/* keep the entries with keep[i], renumbered in order from 1, moving their slots over */
+
+static void entriesKeep (Modset *ms, bool *keep)
+{
+  U32 i, n = 0, N = ms->max ;
+  U32 *newIndex = new0 (N+1, U32) ;
+  for (i = 1 ; i <= N ; ++i) if (keep[i]) newIndex[i] = ++n ;
+  tableRebuild (ms, ms->tableBits, newIndex) ; /* also unmaps */
   for (i = 1 ; i <= N ; ++i)	/* NB index runs from 1..max */
-    if (ms->depth[i] >= min && (!max || ms->depth[i] < max))
-      { modsetIndexFind (ms, ms->value[i], true) ;
-	ms->info[ms->max] = ms->info[i] ;
-	ms->depth[ms->max] = ms->depth[i] ;
+    if (newIndex[i])
+      { U32 j = newIndex[i] ;
+	if (ms->valueHi) ms->valueHi[j] = ms->valueHi[i] ;
+	msDepthSet (ms, j, msDepth (ms, i)) ;
+	ms->info[j] = ms->info[i] ;
+	if (ms->nSample) memmove (msSample (ms, j), msSample (ms, i), ms->nSample*sizeof(U16)) ;
       }
+  memset (ms->depth + n + 1, 0, N - n) ; /* so entries added later start from 0 */
+  memset (ms->info + n + 1, 0, N - n) ;
+  if (ms->nSample) memset (msSample (ms, n+1), 0, (U64)(N - n)*ms->nSample*sizeof(U16)) ;
+  ms->max = n ;
+  free (newIndex) ;
+}
+
+void modsetDepthPrune (Modset *ms, int min, int max)
+{
+  U32 i, N = ms->max ;
+  bool *keep = new0 (N+1, bool) ;
+  for (i = 1 ; i <= N ; ++i)
+    { U32 d = msDepth (ms, i) ; keep[i] = (d >= min && (!max || d < max)) ; }
+  entriesKeep (ms, keep) ;
+  free (keep) ;
   fprintf (stderr, "  pruned Modset from %d to %d with min %d <= depth < max %d\n",
 	   N, ms->max, min, max) ;
 }
 
+static U32 depthBigPairs (Modset *ms, U32 **pairs) /* index,depth pairs for the big depths */
+{
+  U32 i, n = 0 ;
+  for (i = 1 ; i <= ms->max ; ++i) if (ms->depth[i] == MS_DEPTH_BIG) ++n ;
+  U32 *p = *pairs = new (2*n+1, U32) ;
+  for (i = 1 ; i <= ms->max ; ++i)
+    if (ms->depth[i] == MS_DEPTH_BIG) { *p++ = i ; *p++ = msDepthBig (ms, i) ; }
+  return n ;
+}
+
+static void depthBigLoad (Modset *ms, U32 *pairs, U32 n) /* for depth[] already set */
+{ U32 i ;
+  for (i = 0 ; i < n ; ++i, pairs += 2) *depthBigFind (ms, pairs[0], true) = pairs[1] ;
+}
+
 void modsetWrite (Modset *ms, FILE *f)
-{ if (fwrite ("MSHSTv2",8,1,f) != 1) die ("failed to write modset header") ;
+{ if (fwrite ("MSHSTv8",8,1,f) != 1) die ("failed to write modset header") ;
   if (fwrite (&ms->tableBits,sizeof(int),1,f) != 1) die ("failed to write bits") ;
   U32 size = ms->max+1 ; if (fwrite (&size,sizeof(U32),1,f) != 1) die ("failed to write size") ;
+  if (fwrite (&ms->load,sizeof(double),1,f) != 1) die ("failed to write load") ;
   seqhashWrite (ms->hasher, f) ;
-  if (fwrite (ms->index,sizeof(U32),ms->tableSize,f) != ms->tableSize) die ("fail write index") ;
-  if (fwrite (ms->value,sizeof(U64),ms->max+1,f) != ms->max+1) die ("failed to write value") ;
-  if (fwrite (ms->depth,sizeof(U16),ms->max+1,f) != ms->max+1) die ("failed to write depth") ;
+  if (fwrite (ms->bucket,sizeof(MsBucket),ms->nBucket,f) != ms->nBucket) die ("fail write buckets") ;
+  if (ms->valueHi && fwrite (ms->valueHi,sizeof(U64),ms->max+1,f) != ms->max+1)
+    die ("failed to write valueHi") ;
+  if (fwrite (ms->depth,sizeof(U8),ms->max+1,f) != ms->max+1) die ("failed to write depth") ;
   if (fwrite (ms->info,sizeof(U8),ms->max+1,f) != ms->max+1) die ("failed to write info") ;
+  U32 *pairs, nBig = depthBigPairs (ms, &pairs) ;
+  if (fwrite (&nBig,sizeof(U32),1,f) != 1) die ("failed to write nBig") ;
+  if (fwrite (pairs,2*sizeof(U32),nBig,f) != nBig) die ("failed to write big depths") ;
+  free (pairs) ;
+  if (fwrite (&ms->nSample,sizeof(int),1,f) != 1) die ("failed to write nSample") ;
+  U64 nsd = (U64)(ms->max+1) * ms->nSample ;
+  if (fwrite (ms->sampleDepth,sizeof(U16),nsd,f) != nsd) die ("failed to write sample depths") ;
 }
 
-Modset *modsetRead (FILE *f)
-{ char name[8] ;
+/* v2 to v7 have a value[] of the kmers after an index of the same size as the buckets, which is
+   skipped, and the slots are made from value[], in a smaller table if they fit.
+*/
+
+Modset *modsetRead (FILE *f)	/* also reads v2 to v7, v2 to v6 from before load was stored */
+{ char name[8] ;		/* v2 to v5 are without samples, v2 to v4 with U16 depths */
   if (fread (name,8,1,f) != 1) die ("failed to read modset header") ;
-  if (strcmp (name, "MSHSTv2")) die ("bad modset header %s != MSHSTv2", name) ;
+  bool isDepth16 = !strcmp (name, "MSHSTv2") || !strcmp (name, "MSHSTv3") || !strcmp (name, "MSHSTv4") ;
+  bool isNew = !strcmp (name, "MSHSTv8") ;
+  bool isLoad = isNew || !strcmp (name, "MSHSTv7") ;
+  bool isSample = isLoad || !strcmp (name, "MSHSTv6") ;
+  if (!isDepth16 && !isSample && strcmp (name, "MSHSTv5")) die ("bad modset header %s != MSHSTv8", name) ;
   int bits ; if (fread (&bits,sizeof(int),1,f) != 1) die ("failed to read bits") ;
   U32 size ; if (fread (&size,sizeof(U32),1,f) != 1) die ("failed to read size") ;
+  double load = MS_LOAD_DEFAULT ;
+  if (isLoad && fread (&load,sizeof(double),1,f) != 1) die ("failed to read load") ;
   Seqhash *sh = seqhashRead (f) ;
+  int oldBits = bits ;
+  if (!isNew)
+    { if (size > modsetMaxSize (sh, bits, load)) load = MS_LOAD_MAX ; /* filled fuller */
+      while (bits > 20 && size <= modsetMaxSize (sh, bits-1, load)) --bits ;
+    }
   Modset *ms = modsetCreate (sh, bits, size) ;
-  if (fread (ms->index,sizeof(U32),ms->tableSize,f) != ms->tableSize) die ("failed read index") ;
-  if (fread (ms->value,sizeof(U64),size,f) != size) die ("failed to read value") ;
-  if (fread (ms->depth,sizeof(U16),size,f) != size) die ("failed to read depth") ;
+  ms->load = load ;
+  U64 *value = 0 ;
+  if (isNew)
+    { if (fread (ms->bucket,sizeof(MsBucket),ms->nBucket,f) != ms->nBucket) die ("failed read buckets") ; }
+  else
+    { U64 nOld = ((U64)1 << oldBits) >> 4 ;
+      MsBucket buf[1024] ;
+      while (nOld)
+	{ U64 n = nOld < 1024 ? nOld : 1024 ;
+	  if (fread (buf,sizeof(MsBucket),n,f) != n) die ("failed read index") ;
+	  nOld -= n ;
+	}
+      value = new (size, U64) ;
+      if (fread (value,sizeof(U64),size,f) != size) die ("failed to read value") ;
+    }
+  if (ms->valueHi && fread (ms->valueHi,sizeof(U64),size,f) != size) die ("failed to read valueHi") ;
+  U32 i, nBig ;
+  if (isDepth16)
+    { U16 *depth = new (size, U16) ;
+      if (fread (depth,sizeof(U16),size,f) != size) die ("failed to read depth") ;
+      for (i = 0 ; i < size ; ++i) msDepthSet (ms, i, depth[i]) ;
+      free (depth) ;
+    }
+  else if (fread (ms->depth,sizeof(U8),size,f) != size) die ("failed to read depth") ;
   if (fread (ms->info,sizeof(U8),size,f) != size) die ("failed to read info") ;
+  if (!isDepth16)
+    { if (fread (&nBig,sizeof(U32),1,f) != 1) die ("failed to read nBig") ;
+      U32 *pairs = new (2*nBig+1, U32) ;
+      if (fread (pairs,2*sizeof(U32),nBig,f) != nBig) die ("failed to read big depths") ;
+      depthBigLoad (ms, pairs, nBig) ;
+      free (pairs) ;
+    }
   ms->max = size - 1 ;
+  int nSample ;
+  if (isSample)
+    { if (fread (&nSample,sizeof(int),1,f) != 1) die ("failed to read nSample") ;
+      if (nSample)
+	{ modsetSamples (ms, nSample) ;
+	  U64 nsd = (U64)size * nSample ;
+	  if (fread (ms->sampleDepth,sizeof(U16),nsd,f) != nsd) die ("failed to read sample depths") ;
+	}
+    }
+  if (value)
+    { for (i = 1 ; i < size ; ++i) slotAddGrow (ms, value[i], i) ;
+      free (value) ;
+    }
+  return ms ;
+}
+
+/* The map format is uncompressed, with a header page followed by the arrays, each starting
+   on a page boundary, so modsetOpen() can mmap it and use the arrays in place.  The map is
+   private, so pages are shared in the page cache between processes until one writes to them,
+   e.g. depths, when it gets its own copy.  Adding entries copies the whole Modset into memory.
+   The checksum is of the header, so opening doesn't need to touch the rest of the file.
+*/
+
+#define MS_PAGE 4096
+
+typedef struct {
+  char name[8] ;		/* "MSHSTm4" */
+  U64 fileSize ;
+  int tableBits ;
+  U32 size ;			/* max+1 */
+  double load ;
+  U64 offBucket, offValueHi, offDepth, offInfo ; /* offValueHi is 0 if k <= 31 */
+  U64 offBig, nBig ;		/* nBig index,depth U32 pairs for depths >= MS_DEPTH_BIG */
+  U64 offSample ;		/* size*nSample U16 sample depths */
+  int nSample ;
+  char hasher[256] ;		/* as written by seqhashWrite() */
+  U64 checksum ;		/* of the bytes above */
+} MsMapHeader ;
+
+typedef struct {		/* "MSHSTm3", from before slots held remainders - still read */
+  char name[8] ;
+  U64 fileSize ;
+  int tableBits ;
+  U32 size ;
+  double load ;
+  U64 offBucket, offValue, offValueHi, offDepth, offInfo ;
+  U64 offBig, nBig ;
+  U64 offSample ;
+  int nSample ;
+  char hasher[256] ;
+  U64 checksum ;
+} MsMapHeader3 ;
+
+typedef struct {		/* "MSHSTm2", from before samples - still read */
+  char name[8] ;
+  U64 fileSize ;
+  int tableBits ;
+  U32 size ;
+  double load ;
+  U64 offBucket, offValue, offValueHi, offDepth, offInfo ;
+  U64 offBig, nBig ;
+  char hasher[256] ;
+  U64 checksum ;
+} MsMapHeader2 ;
+
+static U64 mapChecksum (void *h, U64 len) /* FNV-1a of the len bytes before the checksum */
+{ U64 x = 14695981039346656037ULL ; U8 *u = (U8*) h, *uEnd = u + len ;
+  while (u < uEnd) { x ^= *u++ ; x *= 1099511628211ULL ; }
+  return x ;
+}
+
+static U64 mapPad (U64 off) { return (off + MS_PAGE - 1) & ~(U64)(MS_PAGE - 1) ; }
+
+static void mapWrite (FILE *f, U64 *off, void *x, U64 len)
+{ static char zero[MS_PAGE] ;
+  if (len && fwrite (x, 1, len, f) != len) die ("failed to write Modset map") ;
+  U64 pad = mapPad (*off + len) - (*off + len) ;
+  if (pad && fwrite (zero, 1, pad, f) != pad) die ("failed to write Modset map") ;
+  *off += len + pad ;
+}
+
+void modsetWriteMap (Modset *ms, char *filename)
+{
+  FILE *f = fopen (filename, "w") ;
+  if (!f) die ("failed to open Modset map file %s", filename) ;
+  MsMapHeader h ; memset (&h, 0, sizeof(h)) ;
+  strcpy (h.name, "MSHSTm4") ;
+  h.tableBits = ms->tableBits ; h.size = ms->max + 1 ; h.load = ms->load ;
+  FILE *g = fmemopen (h.hasher, sizeof(h.hasher), "w") ;
+  if (!g) die ("failed to open hasher buffer") ;
+  seqhashWrite (ms->hasher, g) ; fclose (g) ;
+  h.offBucket = MS_PAGE ;
+  U64 off = mapPad (h.offBucket + ms->nBucket*sizeof(MsBucket)) ;
+  h.offValueHi = ms->valueHi ? off : 0 ;
+  h.offDepth = ms->valueHi ? mapPad (off + h.size*sizeof(U64)) : off ;
+  h.offInfo = mapPad (h.offDepth + h.size*sizeof(U8)) ;
+  U32 *pairs ; h.nBig = depthBigPairs (ms, &pairs) ;
+  h.offBig = mapPad (h.offInfo + h.size*sizeof(U8)) ;
+  h.nSample = ms->nSample ;
+  h.offSample = mapPad (h.offBig + h.nBig*2*sizeof(U32)) ;
+  h.fileSize = mapPad (h.offSample + (U64)h.size*h.nSample*sizeof(U16)) ;
+  h.checksum = mapChecksum (&h, offsetof(MsMapHeader,checksum)) ;
+  off = 0 ;
+  mapWrite (f, &off, &h, sizeof(h)) ;
+  mapWrite (f, &off, ms->bucket, ms->nBucket*sizeof(MsBucket)) ;
+  if (ms->valueHi) mapWrite (f, &off, ms->valueHi, h.size*sizeof(U64)) ;
+  mapWrite (f, &off, ms->depth, h.size*sizeof(U8)) ;
+  mapWrite (f, &off, ms->info, h.size*sizeof(U8)) ;
+  mapWrite (f, &off, pairs, h.nBig*2*sizeof(U32)) ;
+  free (pairs) ;
+  mapWrite (f, &off, ms->sampleDepth, (U64)h.size*h.nSample*sizeof(U16)) ;
+  if (off != h.fileSize) die ("Modset map size mismatch %llu != %llu", off, h.fileSize) ;
+  fclose (f) ;
+}
+
+/* m2 and m3 maps have a value[] of the kmers, from which the slots are made in memory */
+
+static Modset *mapReadOld (char *map, MsMapHeader3 *h, Seqhash *sh)
+{
+  Modset *ms = modsetCreate (sh, h->tableBits, h->size) ;
+  ms->load = h->load ;
+  if (ms->valueHi) memcpy (ms->valueHi, map + h->offValueHi, h->size*sizeof(U64)) ;
+  memcpy (ms->depth, map + h->offDepth, h->size*sizeof(U8)) ;
+  memcpy (ms->info, map + h->offInfo, h->size*sizeof(U8)) ;
+  depthBigLoad (ms, (U32*) (map + h->offBig), h->nBig) ;
+  ms->max = h->size - 1 ;
+  if (h->nSample)
+    { modsetSamples (ms, h->nSample) ;
+      memcpy (ms->sampleDepth, map + h->offSample, (U64)h->size*h->nSample*sizeof(U16)) ;
+    }
+  U64 *value = (U64*) (map + h->offValue) ;
+  U32 i ;
+  for (i = 1 ; i <= ms->max ; ++i) slotAddGrow (ms, value[i], i) ;
+  return ms ;
+}
+
+Modset *modsetOpen (char *filename)
+{
+  int fd = open (filename, O_RDONLY) ;
+  if (fd < 0) die ("failed to open mod file %s", filename) ;
+  char buf[sizeof(MsMapHeader3)] ;	/* the largest header */
+  bool isRead = (read (fd, buf, sizeof(buf)) == sizeof(buf)) ;
+  MsMapHeader h ; memcpy (&h, buf, sizeof(h)) ;
+  MsMapHeader3 h3 ; memcpy (&h3, buf, sizeof(h3)) ;
+  if (isRead && !memcmp (h.name, "MSHSTm1", 8))
+    die ("%s is in the old map format, with U16 depths - please remake it", filename) ;
+  if (isRead && !memcmp (h.name, "MSHSTm2", 8)) /* convert to the m3 header */
+    { MsMapHeader2 h2 ; memcpy (&h2, buf, sizeof(h2)) ;
+      if (h2.checksum != mapChecksum (&h2, offsetof(MsMapHeader2,checksum)))
+	die ("bad checksum in Modset map header %s", filename) ;
+      memset (&h3, 0, sizeof(h3)) ; strcpy (h3.name, "MSHSTm3") ;
+      h3.fileSize = h2.fileSize ; h3.tableBits = h2.tableBits ; h3.size = h2.size ; h3.load = h2.load ;
+      h3.offBucket = h2.offBucket ; h3.offValue = h2.offValue ; h3.offValueHi = h2.offValueHi ;
+      h3.offDepth = h2.offDepth ; h3.offInfo = h2.offInfo ; h3.offBig = h2.offBig ; h3.nBig = h2.nBig ;
+      memcpy (h3.hasher, h2.hasher, sizeof(h3.hasher)) ;
+      h3.checksum = mapChecksum (&h3, offsetof(MsMapHeader3,checksum)) ;
+    }
+  bool isOld = isRead && !memcmp (h3.name, "MSHSTm3", 8) ;
+  if (!isRead || (!isOld && memcmp (h.name, "MSHSTm4", 8)))
+    { close (fd) ;			/* not a map - read it the old way */
+      FILE *f = fzopen (filename, "r") ;
+      if (!f) die ("failed to open mod file %s", filename) ;
+      Modset *ms = modsetRead (f) ;
+      fclose (f) ;
+      return ms ;
+    }
+  struct stat st ;
+  if (isOld ? h3.checksum != mapChecksum (&h3, offsetof(MsMapHeader3,checksum))
+            : h.checksum != mapChecksum (&h, offsetof(MsMapHeader,checksum)))
+    die ("bad checksum in Modset map header %s", filename) ;
+  U64 fileSize = isOld ? h3.fileSize : h.fileSize ;
+  if (fstat (fd, &st) || st.st_size != fileSize)
+    die ("Modset map %s is %llu bytes, not %llu", filename, (U64)st.st_size, fileSize) ;
+  char *map = mmap (0, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) ;
+  close (fd) ;
+  if (map == MAP_FAILED) die ("failed to mmap Modset map %s", filename) ;
+  FILE *g = fmemopen (isOld ? h3.hasher : h.hasher, sizeof(h.hasher), "r") ;
+  if (!g) die ("failed to open hasher buffer") ;
+  Seqhash *sh = seqhashRead (g) ; fclose (g) ;
+  if (isOld)
+    { Modset *ms = mapReadOld (map, &h3, sh) ;
+      munmap (map, fileSize) ;
+      return ms ;
+    }
+  Modset *ms = new0 (1, Modset) ;
+  ms->hasher = sh ;
+  tableSet (ms, h.tableBits) ;
+  ms->load = h.load ;
+  ms->size = h.size ; ms->max = h.size - 1 ;
+  ms->map = map ; ms->mapSize = h.fileSize ;
+  ms->bucket = (MsBucket*) (map + h.offBucket) ;
+  if (h.offValueHi) ms->valueHi = (U64*) (map + h.offValueHi) ;
+  ms->depth = (U8*) (map + h.offDepth) ;
+  ms->info = (U8*) (map + h.offInfo) ;
+  depthBigLoad (ms, (U32*) (map + h.offBig), h.nBig) ;
+  if ((ms->nSample = h.nSample)) ms->sampleDepth = (U16*) (map + h.offSample) ;
   return ms ;
 }
 
+void modsetUnmap (Modset *ms)	/* copy a mapped Modset into ordinary memory */
+{
+  if (!ms->map) return ;
+  MsBucket *bucket = bucketCreate (ms->nBucket) ;
+  memcpy (bucket, ms->bucket, ms->nBucket*sizeof(MsBucket)) ;
+  ms->bucket = bucket ;
+  if (ms->valueHi)
+    { U64 *valueHi = new (ms->size, U64) ; memcpy (valueHi, ms->valueHi, ms->size*sizeof(U64)) ;
+      ms->valueHi = valueHi ;
+    }
+  U8 *depth = new (ms->size, U8) ; memcpy (depth, ms->depth, ms->size*sizeof(U8)) ;
+  ms->depth = depth ;
+  U8 *info = new (ms->size, U8) ; memcpy (info, ms->info, ms->size*sizeof(U8)) ;
+  ms->info = info ;
+  if (ms->nSample)
+    { U16 *sd = new ((U64)ms->size*ms->nSample, U16) ;
+      memcpy (sd, ms->sampleDepth, (U64)ms->size*ms->nSample*sizeof(U16)) ;
+      ms->sampleDepth = sd ;
+    }
+  munmap (ms->map, ms->mapSize) ;
+  ms->map = 0 ; ms->mapSize = 0 ;
+}
+
+static inline bool hasherSame (Seqhash *sh1, Seqhash *sh2)
+{ return sh1->w == sh2->w && sh1->k == sh2->k && sh1->factor1 == sh2->factor1 && sh1->link == sh2->link ; }
+
+static inline void mergeEntry (Modset *ms1, U32 i1, Modset *ms2, U32 i2) /* add i2 into i1 */
+{ msDepthAdd (ms1, i1, msDepth (ms2, i2)) ;
+  int c = msCopy(ms1,i1) + msCopy(ms2,i2) ; if (c > 3) c = 3 ;
+  ms1->info[i1] = (ms1->info[i1] & ~0x3) | c ;
+  int s ;			/* ms1->nSample >= ms2->nSample */
+  for (s = 0 ; s < ms2->nSample ; ++s) msSampleAdd (ms1, i1, s, msSample(ms2,i2)[s]) ;
+}
+
 bool modsetMerge (Modset *ms1, Modset *ms2)
 {
-  U32 i, index ;
-  /* first check that the hashers are identical */
-  Seqhash *sh1 = ms1->hasher, *sh2 = ms2->hasher ;
-  if (sh1->w != sh2->w || sh1->k != sh2->k || sh1->factor1 != sh2->factor1) return false ;
-  /* need to expand size of ms1 to make space */
-  U64 newSize = ms1->max + ms2->max + 1 ;
-  if (newSize >= (ms1->tableSize >> 2)) newSize = (ms1->tableSize >> 2) - 1 ;
-  resize (ms1->value, ms1->size, newSize, U64) ; 
-  resize (ms1->depth, ms1->size, newSize, U16) ; 
-  resize (ms1->info, ms1->size, newSize, U8) ;
-  ms1->size = newSize ;
-  /* then pass through ms2 adding into ms1 */
+  U32 i ;
+  if (!hasherSame (ms1->hasher, ms2->hasher)) return false ;
+  modsetSamples (ms1, ms2->nSample) ;
+  /* pass through ms2 adding into ms1, which grows as needed */
+  U64 *value = modsetValues (ms2) ;
   for (i = 1 ; i <= ms2->max ; ++i)
-    { index = modsetIndexFind (ms1, ms2->value[i], true) ;
-      U32 d = ms1->depth[index] + (U32) ms2->depth[i] ; if (d > U16MAX) d = U16MAX ;
-      ms1->depth[index] = d ;
-      int c = msCopy(ms1,index) + msCopy(ms2,i) ; if (c > 3) c = 3 ;
-      ms1->info[index] &= 0x3 ; ms1->info[index] |= c ;
+    mergeEntry (ms1, modsetIndexFindLong (ms1, msValue (ms2, value, i), true), ms2, i) ;
+  free (value) ;
+  return true ;
+}
+
+/* To merge many Modsets in parallel, the kmers are split over nPart parts by a hash.  The slots
+   of each input are cut into chunks of MS_MERGE_CHUNK, and the chunks are sorted by part in
+   parallel, so each input is read once.  Then each thread merges its part of every chunk, in
+   order, into a private Modset, and looks those kmers up in ms, which doesn't change, updating
+   those it finds.  The new kmers left over are appended to ms with modsetConcat(), as the parts
+   are disjoint.  Depths and copy numbers are as for a chain of modsetMerge(), and the existing
+   entries of ms keep their indices, but the new entries are in a different order.
+*/
+
+#define MS_MERGE_CHUNK (1 << 20)
+
+typedef struct {
+  Modset *ms ;
+  U64 p0 ;			/* first slot */
+  U32 n ;			/* number of slots */
+  U32 *pos ;			/* offsets of the used slots from p0, by part */
+  U32 *start ;			/* part t is pos[start[t]..start[t+1]-1] */
+} MsMergeChunk ;
+
+static inline int mergePart (U128 kmer, int n) /* different bits from modsetShard() */
+{ return ((((U64)kmer + (U64)(kmer >> 64)) * 0x9e3779b97f4a7c15ULL) >> 16) % n ; }
+
+static void mergeChunkSort (MsMergeChunk *c, int nPart) /* counting sort of the used slots */
+{
+  U32 i, *part = new (c->n, U32), *fill = new (nPart, U32) ;
+  U128 kmer ;
+  int t ;
+  c->start = new0 (nPart+1, U32) ;
+  for (i = 0 ; i < c->n ; ++i)
+    if (modsetSlot (c->ms, c->p0 + i, &kmer))
+      { part[i] = mergePart (kmer, nPart) ; ++c->start[part[i]+1] ; }
+    else part[i] = U32MAX ;
+  for (t = 0 ; t < nPart ; ++t) c->start[t+1] += c->start[t] ;
+  memcpy (fill, c->start, nPart*sizeof(U32)) ;
+  c->pos = new (c->start[nPart] + 1, U32) ;
+  for (i = 0 ; i < c->n ; ++i) if (part[i] != U32MAX) c->pos[fill[part[i]]++] = i ;
+  free (part) ; free (fill) ;
+}
+
+bool modsetMergeMany (Modset *ms, Modset **ms2, int n, int nThreads)
+{
+  int t, j ;
+  U64 c, nChunk = 0 ;
+  for (t = 0 ; t < n ; ++t) if (!hasherSame (ms->hasher, ms2[t]->hasher)) return false ;
+  for (t = 0 ; t < n ; ++t) modsetSamples (ms, ms2[t]->nSample) ;
+  if (nThreads < 1) nThreads = 1 ;
+  for (j = 0 ; j < n ; ++j) nChunk += (modsetSlots (ms2[j]) + MS_MERGE_CHUNK - 1) / MS_MERGE_CHUNK ;
+  MsMergeChunk *chunk = new0 (nChunk, MsMergeChunk) ;
+  for (j = 0, c = 0 ; j < n ; ++j)
+    { U64 p, nSlot = modsetSlots (ms2[j]) ;
+      for (p = 0 ; p < nSlot ; p += MS_MERGE_CHUNK, ++c)
+	{ chunk[c].ms = ms2[j] ; chunk[c].p0 = p ;
+	  chunk[c].n = (nSlot - p < MS_MERGE_CHUNK) ? nSlot - p : MS_MERGE_CHUNK ;
+	}
+    }
+#ifdef OMP
+#pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+#endif
+  for (c = 0 ; c < nChunk ; ++c) mergeChunkSort (&chunk[c], nThreads) ;
+
+  Modset **part = new (nThreads, Modset*) ;
+#ifdef OMP
+#pragma omp parallel for num_threads(nThreads) schedule(static, 1)
+#endif
+  for (t = 0 ; t < nThreads ; ++t)
+    { Modset *mp = part[t] = modsetCreate (ms->hasher, 20, 0) ;
+      modsetSamples (mp, ms->nSample) ;
+      U32 i, k ;
+      U64 c ;
+      U128 kmer ;
+      for (c = 0 ; c < nChunk ; ++c)
+	{ MsMergeChunk *ch = &chunk[c] ;
+	  for (k = ch->start[t] ; k < ch->start[t+1] ; ++k)
+	    { i = modsetSlot (ch->ms, ch->p0 + ch->pos[k], &kmer) ;
+	      mergeEntry (mp, modsetIndexFindLong (mp, kmer, true), ch->ms, i) ;
+	    }
+	}
+      U64 *value = modsetValues (mp) ;
+      bool *keep = new0 (mp->max + 1, bool) ;
+      for (i = 1 ; i <= mp->max ; ++i)	/* merge those in ms, and keep the rest */
+	{ U32 index = modsetIndexFindLong (ms, msValue (mp, value, i), false) ;
+	  if (index) mergeEntry (ms, index, mp, i) ; else keep[i] = true ;
+	}
+      entriesKeep (mp, keep) ;
+      free (keep) ; free (value) ;
+    }
+  for (c = 0 ; c < nChunk ; ++c) { free (chunk[c].pos) ; free (chunk[c].start) ; }
+  free (chunk) ;
+  for (t = 0 ; t < nThreads ; ++t) { modsetConcat (ms, part[t]) ; modsetDestroy (part[t]) ; }
+  free (part) ;
+  return true ;
+}
+
+/* Shards from modsetShard() are disjoint, so the entries of ms2 can be appended to ms1 without
+   looking for them in ms1.
+*/
+
+bool modsetConcat (Modset *ms1, Modset *ms2)
+{
+  if (!hasherSame (ms1->hasher, ms2->hasher)) return false ;
+  modsetSamples (ms1, ms2->nSample) ;
+  modsetReserve (ms1, ms2->max) ;
+  U32 i, base = ms1->max ;
+  U64 p, nSlot = modsetSlots (ms2) ;
+  U128 kmer ;
+  for (p = 0 ; p < nSlot ; ++p)
+    if ((i = modsetSlot (ms2, p, &kmer))) slotAddGrow (ms1, (U64) kmer, base + i) ;
+  if (ms1->valueHi) memcpy (ms1->valueHi + base + 1, ms2->valueHi + 1, ms2->max * sizeof(U64)) ;
+  memcpy (ms1->depth + base + 1, ms2->depth + 1, ms2->max * sizeof(U8)) ;
+  memcpy (ms1->info + base + 1, ms2->info + 1, ms2->max) ;
+  ms1->max += ms2->max ;
+  for (i = base + 1 ; i <= ms1->max ; ++i)
+    { if (ms1->depth[i] == MS_DEPTH_BIG) msDepthSetBig (ms1, i, msDepthBig (ms2, i - base)) ;
+      if (ms2->nSample)
+	memcpy (msSample (ms1, i), msSample (ms2, i - base), ms2->nSample*sizeof(U16)) ;
+    }
+  return true ;
+}
+
+/* Since a hash divisible by w << j is divisible by w, a Modset at density w contains all
+   those at w << j, with the same depths, so we can derive the coarser ones by filtering.
+*/
+
+Modset *modsetCoarsen (Modset *ms, int j)
+{
+  if (ms->hasher->link) die ("can't coarsen a Modset of linked seeds") ;
+  Seqhash *sh = seqhashCoarsen (ms->hasher, j) ;
+  U32 i, n = 0 ;
+  U64 *value = modsetValues (ms) ;
+  for (i = 1 ; i <= ms->max ; ++i)
+    if (seqhashLevel (ms->hasher, seqhashKmer (ms->hasher, msValue (ms, value, i))) >= j) ++n ;
+  int bits = ms->tableBits - j ; if (bits < 20) bits = 20 ;
+  while (n+1 > modsetMaxSize (sh, bits, MS_LOAD_DEFAULT)) ++bits ;
+  Modset *msj = modsetCreate (sh, bits, n+1) ;
+  modsetSamples (msj, ms->nSample) ;
+  for (i = 1 ; i <= ms->max ; ++i)
+    if (seqhashLevel (ms->hasher, seqhashKmer (ms->hasher, msValue (ms, value, i))) >= j)
+      { U32 index = modsetIndexFindLong (msj, msValue (ms, value, i), true) ;
+	msDepthSet (msj, index, msDepth (ms, i)) ;
+	msj->info[index] = ms->info[i] ;
+	if (ms->nSample) memcpy (msSample (msj, index), msSample (ms, i), ms->nSample*sizeof(U16)) ;
+      }
+  free (value) ;
+  return msj ;
+}
+
+/* Combining sets by probing for each entry of one in the index of another jumps around memory
+   at random.  Merging the sets' entries in kmer order instead reads each sequentially, with a
+   small buffer per stream, so any number can be merged at once, and a run can be split by
+   kmer into parts to merge in parallel, since they are read with pread().  The sort is done once per mod
+   file and cached in <mod file>.srt, which records the size, modification time and a checksum
+   of the first page of the mod file, so it is remade if any of these change.  It is written to
+   a unique temporary name and renamed when complete, so concurrent makers don't collide.  If
+   it can't be written, e.g. because the directory is read-only, the run goes to an anonymous
+   temporary file instead.
+*/
+
+#define MS_RUN_BUF 4096		/* entries buffered per stream */
+
+typedef struct {
+  char name[8] ;		/* "MSHSTs2" */
+  U64 srcSize ;			/* size and modification time of the mod file */
+  I64 srcTime ;
+  U64 srcHead ;			/* checksum of its first MS_PAGE bytes, its header */
+  U64 n ;
+  char hasher[256] ;		/* as written by seqhashWrite() */
+} MsRunHeader ;
+
+static int runOrder (const void *a, const void *b)
+{ MsRunEntry *x = (MsRunEntry*)a, *y = (MsRunEntry*)b ;
+  if (x->hi != y->hi) return (x->hi < y->hi) ? -1 : 1 ;
+  return (x->lo < y->lo) ? -1 : (x->lo > y->lo) ;
+}
+
+static inline U128 runKmer (MsRunEntry *e) { return ((U128)e->hi << 64) | e->lo ; }
+
+static FILE *runMake (char *filename, MsRunHeader *h)
+{
+  Modset *ms = modsetOpen (filename) ;
+  MsRunEntry *e = new0 (ms->max + 1, MsRunEntry) ; /* new0 so the padding is written as 0 */
+  U64 p, nSlot = modsetSlots (ms) ;
+  U128 kmer ;
+  for (p = 0 ; p < nSlot ; ++p)
+    { U32 i = modsetSlot (ms, p, &kmer) ;
+      if (!i) continue ;
+      e[i-1].lo = (U64) kmer ; e[i-1].hi = (U64) (kmer >> 64) ;
+      e[i-1].depth = msDepth (ms, i) ; e[i-1].info = ms->info[i] ;
+    }
+  qsort (e, ms->max, sizeof(MsRunEntry), runOrder) ;
+  h->n = ms->max ;
+  FILE *g = fmemopen (h->hasher, sizeof(h->hasher), "w") ;
+  if (!g) die ("failed to open hasher buffer") ;
+  seqhashWrite (ms->hasher, g) ; fclose (g) ;
+  seqhashDestroy (ms->hasher) ; modsetDestroy (ms) ;
+
+  char runName[strlen(filename)+8], tmpName[strlen(filename)+16] ;
+  sprintf (runName, "%s.srt", filename) ;
+  sprintf (tmpName, "%s.srt.XXXXXX", filename) ; /* renamed when complete */
+  int fd = mkstemp (tmpName) ;
+  FILE *f = (fd >= 0) ? fdopen (fd, "w+") : 0 ;
+  if (fd >= 0 && !f) { close (fd) ; unlink (tmpName) ; }
+  bool isCache = (f != 0) ;
+  if (!f && !(f = tmpfile ())) die ("failed to open a file for the sorted run of %s", filename) ;
+  if (fwrite (h, sizeof(MsRunHeader), 1, f) != 1
+      || fwrite (e, sizeof(MsRunEntry), h->n, f) != h->n || fflush (f))
+    die ("failed to write the sorted run of %s", filename) ;
+  free (e) ;
+  if (isCache && rename (tmpName, runName)) die ("failed to rename %s to %s", tmpName, runName) ;
+  return f ;
+}
+
+static U64 runSrcHead (char *filename) /* checksum of the first MS_PAGE bytes of the file */
+{
+  char buf[MS_PAGE] ;
+  int fd = open (filename, O_RDONLY) ;
+  if (fd < 0) die ("failed to open mod file %s", filename) ;
+  ssize_t n = read (fd, buf, MS_PAGE) ;
+  close (fd) ;
+  if (n < 0) die ("failed to read mod file %s", filename) ;
+  return mapChecksum (buf, n) ;
+}
+
+MsRun *modsetRunOpen (char *filename)
+{
+  struct stat st, stRun ;
+  if (stat (filename, &st)) die ("failed to open mod file %s", filename) ;
+  U64 srcHead = runSrcHead (filename) ;
+  char runName[strlen(filename)+8] ;
+  sprintf (runName, "%s.srt", filename) ;
+  MsRunHeader h ;
+  FILE *f = fopen (runName, "r") ;
+  if (f && (fread (&h, sizeof(h), 1, f) != 1 || memcmp (h.name, "MSHSTs2", 8)
+	    || h.srcSize != st.st_size || h.srcTime != st.st_mtime || h.srcHead != srcHead
+	    || fstat (fileno (f), &stRun) || stRun.st_size != sizeof(h) + h.n*sizeof(MsRunEntry)))
+    { fclose (f) ; f = 0 ; }	/* out of date or broken - remake it */
+  if (!f)
+    { memset (&h, 0, sizeof(h)) ;
+      strcpy (h.name, "MSHSTs2") ;
+      h.srcSize = st.st_size ; h.srcTime = st.st_mtime ; h.srcHead = srcHead ;
+      f = runMake (filename, &h) ;
+    }
+  MsRun *r = new0 (1, MsRun) ;
+  FILE *g = fmemopen (h.hasher, sizeof(h.hasher), "r") ;
+  if (!g) die ("failed to open hasher buffer") ;
+  r->hasher = seqhashRead (g) ; fclose (g) ;
+  if ((r->fd = dup (fileno (f))) < 0) die ("failed to dup sorted run of %s", filename) ;
+  fclose (f) ;			/* a tmpfile() lasts until r->fd is closed */
+  r->n = h.n ;
+  return r ;
+}
+
+void modsetRunClose (MsRun *r) { close (r->fd) ; seqhashDestroy (r->hasher) ; free (r) ; }
+
+static void runRead (MsRun *r, U64 i, U64 n, MsRunEntry *e) /* entries i..i+n-1 into e */
+{ size_t len = n * sizeof(MsRunEntry) ;
+  if (pread (r->fd, e, len, sizeof(MsRunHeader) + i*sizeof(MsRunEntry)) != len)
+    die ("failed to read sorted run") ;
+}
+
+U64 modsetRunFind (MsRun *r, U128 kmer)
+{ U64 a = 0, b = r->n ;
+  MsRunEntry e ;
+  while (a < b)
+    { U64 m = a + (b - a) / 2 ;
+      runRead (r, m, 1, &e) ;
+      if (runKmer (&e) < kmer) a = m + 1 ; else b = m ;
+    }
+  return a ;
+}
+
+MsRunStream *modsetRunStream (MsRun *r, U64 start, U64 end)
+{ MsRunStream *s = new0 (1, MsRunStream) ;
+  s->r = r ; s->i = start ; s->iEnd = end ;
+  s->buf = new (MS_RUN_BUF, MsRunEntry) ;
+  return s ;
+}
+
+MsRunEntry *modsetRunNext (MsRunStream *s)
+{ if (s->iBuf == s->nBuf)
+    { if (s->i >= s->iEnd) return 0 ;
+      s->nBuf = (s->iEnd - s->i < MS_RUN_BUF) ? s->iEnd - s->i : MS_RUN_BUF ;
+      runRead (s->r, s->i, s->nBuf, s->buf) ;
+      s->i += s->nBuf ; s->iBuf = 0 ;
+    }
+  return &s->buf[s->iBuf++] ;
+}
+
+void modsetRunStreamDestroy (MsRunStream *s) { free (s->buf) ; free (s) ; }
+
+/* The output is in kmer order, with depths summed and copy numbers added as by modsetMerge()
+   over the sets in r[0..nIn-1] that pass the depth filter, and the other info bits from the
+   first of them.  Sets only count as containing a kmer if min <= depth < max, or max 0.
+   Returns 0 if the hashers differ.
+*/
+
+Modset *modsetRunSelect (MsRun **r, int n, int nIn, int minIn, U32 min, U32 max)
+{
+  int j ;
+  for (j = 1 ; j < n ; ++j) if (!hasherSame (r[0]->hasher, r[j]->hasher)) return 0 ;
+  Seqhash *sh = new (1, Seqhash) ; *sh = *r[0]->hasher ; /* r[0] keeps its own */
+  Modset *ms = modsetCreate (sh, 20, 0) ;
+  MsRunStream **s = new (n, MsRunStream*) ;
+  MsRunEntry **e = new (n, MsRunEntry*) ;
+  for (j = 0 ; j < n ; ++j) { s[j] = modsetRunStream (r[j], 0, r[j]->n) ; e[j] = modsetRunNext (s[j]) ; }
+  while (true)
+    { MsRunEntry *eMin = 0 ;	/* n is small, so scan for the next kmer rather than keep a heap */
+      for (j = 0 ; j < n ; ++j)
+	if (e[j] && (!eMin || runKmer (e[j]) < runKmer (eMin))) eMin = e[j] ;
+      if (!eMin) break ;
+      U128 kmer = runKmer (eMin) ;
+      U64 depth = 0 ;
+      int nPresent = 0, copy = 0 ;
+      bool isOut = false ;
+      U8 info = 0 ;
+      for (j = 0 ; j < n ; ++j)
+	if (e[j] && runKmer (e[j]) == kmer)
+	  { if (e[j]->depth >= min && (!max || e[j]->depth < max))
+	      { if (j >= nIn) isOut = true ;
+		else
+		  { if (!nPresent++) info = e[j]->info ;
+		    depth += e[j]->depth ; copy += e[j]->info & 0x3 ;
+		  }
+	      }
+	    e[j] = modsetRunNext (s[j]) ; /* NB this can overwrite *eMin */
+	  }
+      if (isOut || nPresent < minIn) continue ;
+      U32 index = modsetIndexFindLong (ms, kmer, true) ;
+      msDepthSet (ms, index, depth < U32MAX ? depth : U32MAX) ;
+      ms->info[index] = (info & ~0x3) | (copy < 3 ? copy : 3) ;
     }
+  for (j = 0 ; j < n ; ++j) modsetRunStreamDestroy (s[j]) ;
+  free (s) ; free (e) ;
+  return ms ;
+}
+
+/* shared[i*n+j] is set to the number of kmers in both r[i] and r[j], counting those with
+   min <= depth < max as for modsetRunSelect(), so shared[i*n+i] is the size of r[i].  The
+   kmers are split into parts at quantiles of the largest run, and each thread merges its
+   parts into its own counts, which are added at the end.  The cost per kmer is linear in n to
+   find it, plus quadratic in the number of runs that contain it.  Returns false if the
+   hashers differ.
+*/
+
+bool modsetRunShared (MsRun **r, int n, U32 min, U32 max, U64 *shared, int nThreads)
+{
+  int j, t, big = 0 ;
+  for (j = 1 ; j < n ; ++j) if (!hasherSame (r[0]->hasher, r[j]->hasher)) return false ;
+  for (j = 1 ; j < n ; ++j) if (r[j]->n > r[big]->n) big = j ;
+  if (nThreads < 1) nThreads = 1 ;
+  int p, nPart = (nThreads > 1) ? 4*nThreads : 1 ; /* more parts than threads, for balance */
+  U64 *bound = new ((nPart+1)*n, U64) ; /* part p of r[j] is bound[p*n+j] .. bound[(p+1)*n+j]-1 */
+  for (j = 0 ; j < n ; ++j) { bound[j] = 0 ; bound[nPart*n+j] = r[j]->n ; }
+  for (p = 1 ; p < nPart ; ++p)
+    { MsRunEntry e ;
+      runRead (r[big], r[big]->n * p / nPart, 1, &e) ;
+      for (j = 0 ; j < n ; ++j) bound[p*n+j] = modsetRunFind (r[j], runKmer (&e)) ;
+    }
+  U64 *count = new0 ((U64)nThreads*n*n, U64) ;
+#ifdef OMP
+#pragma omp parallel for num_threads(nThreads) schedule(static, 1)
+#endif
+  for (t = 0 ; t < nThreads ; ++t)
+    { U64 *c = count + (U64)t*n*n ;
+      MsRunStream **s = new (n, MsRunStream*) ;
+      MsRunEntry **e = new (n, MsRunEntry*) ;
+      int i, a, b, m, q, *in = new (n, int) ;
+      for (q = t ; q < nPart ; q += nThreads)
+	{ for (i = 0 ; i < n ; ++i)
+	    { s[i] = modsetRunStream (r[i], bound[q*n+i], bound[(q+1)*n+i]) ;
+	      e[i] = modsetRunNext (s[i]) ;
+	    }
+	  while (true)
+	    { MsRunEntry *eMin = 0 ;
+	      for (i = 0 ; i < n ; ++i)
+		if (e[i] && (!eMin || runKmer (e[i]) < runKmer (eMin))) eMin = e[i] ;
+	      if (!eMin) break ;
+	      U128 kmer = runKmer (eMin) ;
+	      for (i = 0, m = 0 ; i < n ; ++i)
+		if (e[i] && runKmer (e[i]) == kmer)
+		  { if (e[i]->depth >= min && (!max || e[i]->depth < max)) in[m++] = i ;
+		    e[i] = modsetRunNext (s[i]) ;
+		  }
+	      for (a = 0 ; a < m ; ++a)	/* in[] is increasing, so this fills the upper triangle */
+		{ U64 *row = c + (U64)in[a]*n ;
+		  for (b = a ; b < m ; ++b) ++row[in[b]] ;
+		}
+	    }
+	  for (i = 0 ; i < n ; ++i) modsetRunStreamDestroy (s[i]) ;
+	}
+      free (s) ; free (e) ; free (in) ;
+    }
+  int i ;
+  for (i = 0 ; i < n ; ++i)
+    for (j = i ; j < n ; ++j)
+      { U64 x = 0 ;
+	for (t = 0 ; t < nThreads ; ++t) x += count[(U64)t*n*n + (U64)i*n + j] ;
+	shared[(U64)i*n+j] = shared[(U64)j*n+i] = x ;
+      }
+  free (count) ; free (bound) ;
   return true ;
 }
 
+static int depthOrder (const void *a, const void *b)
+{ U32 x = *(U32*)a, y = *(U32*)b ; return (x < y) ? -1 : (x > y) ; }
+
 void modsetSummary (Modset *ms, FILE *f)
 {
   seqhashReport (ms->hasher, f) ;
   fprintf (f, "MS table bits %d size %llu number of entries %u",
 	   ms->tableBits, ms->tableSize, ms->max) ;
   if (!ms->max) { fputc ('\n', f) ; return ; }
+  fprintf (f, " table bytes per entry %.1f at load %.2f",
+	   ms->nBucket*sizeof(MsBucket) / (double)ms->max, ms->max / (double)modsetSlots (ms)) ;
   U32 i, copy[4] ; copy[0] = copy[1] = copy[2] = copy[3] = 0 ;
   Array h = arrayCreate (256, U32) ;
+  Array big = arrayCreate (256, U32) ; /* depths >= U16MAX, few, so sort them */
+  U64 sum = ms->max, tot = 0 ;
   for (i = 1 ; i <= ms->max ; ++i)
-    { if (ms->depth[i] < arrayMax(h)) ++arr(h,ms->depth[i],U32) ; /* more efficient to check */
-      else ++array(h,ms->depth[i],U32) ;
+    { U32 d = msDepth (ms, i) ;
+      if (d < arrayMax(h)) ++arr(h,d,U32) ; /* more efficient to check */
+      else if (d < U16MAX) ++array(h,d,U32) ;
+      else array(big,arrayMax(big),U32) = d ;
+      tot += d ;
       ++copy[msCopy(ms,i)] ;
     }
-  U64 sum = 0, tot = 0 ;
-  for (i = 0 ; i < arrayMax(h) ; ++i) { sum += arr(h,i,U32) ; tot += i * arr(h,i,U32) ; }
+  arraySort (big, depthOrder) ;
   I64 htot = tot / 2 ;
-  for (i = 0 ; i < arrayMax(h) ; ++i) { htot -= i*arr(h,i,U32) ; if (htot < 0) break ; }
+  U32 n50 = 0, j ;
+  for (i = 0 ; i < arrayMax(h) && htot >= 0 ; ++i) { htot -= i*(U64)arr(h,i,U32) ; n50 = i ; }
+  for (j = 0 ; j < arrayMax(big) && htot >= 0 ; ++j) { htot -= arr(big,j,U32) ; n50 = arr(big,j,U32) ; }
   fprintf (f, " total count %llu\nMS average depth %.1f N50 depth %u",
-	   tot, tot / (double)sum , i) ;
+	   tot, tot / (double)sum , n50) ;
   if (copy[0] < ms->max)
     fprintf (f, " copy0 %u copy1 %u copy2 %u copyM %u", copy[0], copy[1], copy[2], copy[3]) ;
   fputc ('\n', f) ;
-  arrayDestroy (h) ;
+  if (ms->nSample)
+    { U64 *sTot = new0 (ms->nSample, U64) ;
+      int s ;
+      for (i = 1 ; i <= ms->max ; ++i)
+	{ U16 *sd = msSample (ms, i) ; for (s = 0 ; s < ms->nSample ; ++s) sTot[s] += sd[s] ; }
+      fprintf (f, "MS %d samples with total counts", ms->nSample) ;
+      for (s = 0 ; s < ms->nSample ; ++s) fprintf (f, " %llu", sTot[s]) ;
+      fputc ('\n', f) ;
+      free (sTot) ;
+    }
+  arrayDestroy (h) ; arrayDestroy (big) ;
+}
+
+#ifdef TEST
+
+/* Builds TEST_SETS Modsets from a pool of random modimizers with known depths, then checks
+   each operation against the depths worked out directly: the bucket layout and Robin Hood
+   order, growth, and modsetReserve() with the parallel add, the compressed and mapped round
+   trips with their load, serial and parallel merges, pruning and coarsening, depths past
+   the U8 counts and sample columns up to saturation, kmers recovered from the slot
+   remainders, reading v7 files, and the set operations and shared counts via sorted runs.
+   Run as: modset [k] [nPool] [nThreads]
+*/
+
+#define TEST_SETS 3
+typedef struct { U64 depth ; U8 info ; U16 sample[TEST_SETS] ; } TestEntry ; /* depth 0 if absent */
+
+static U128 *testPool ;		/* the kmers - the first testN are used in sets, then testExtra more */
+static int testN, testExtra ;
+static char *testStem ;
+
+static void bucketCheck (char *what, Modset *ms) /* every entry in one slot, in Robin Hood order */
+{
+  U64 p, nSlot = modsetSlots (ms), nUsed = 0 ;
+  if (ms->max >= ms->size || ms->max + 1 > modsetMaxSize (ms->hasher, ms->tableBits, ms->load))
+    die ("%s: %u entries overfill size %u or load %.2f at %d bits", what, ms->max, ms->size, ms->load, ms->tableBits) ;
+  if (keyUnmix (ms, keyMix (ms, 0x123456789abcdefULL & ms->keyMask)) != (0x123456789abcdefULL & ms->keyMask))
+    die ("%s: the key mix does not invert", what) ;
+  bool *seen = new0 (ms->max + 1, bool) ;
+  for (p = 0 ; p < nSlot ; ++p)
+    { U128 kmer ;
+      U32 i = modsetSlot (ms, p, &kmer) ;
+      if (!i) continue ;
+      if (i > ms->max || seen[i]) die ("%s: bad or repeated index %u in slot %llu", what, i, p) ;
+      seen[i] = true ; ++nUsed ;
+      if (modsetIndexFindLong (ms, kmer, false) != i) die ("%s: slot %llu kmer doesn't find %u", what, p, i) ;
+      U64 m = keyMix (ms, (U64) kmer), b = p / ms->nSlot, d = (b - mixHome (ms, m)) & ms->bucketMask ;
+      if (d > MS_DISP_MAX) die ("%s: slot %llu is %llu buckets from home", what, p, d) ;
+      if (slotTag (ms, slotBucket (ms, p), p % ms->nSlot) != ((mixRem (ms, m) << MS_DISP_BITS) | d))
+	die ("%s: slot %llu has the wrong tag for its kmer", what, p) ;
+      if (!d && !(p % ms->nSlot)) continue ;	/* first slot of its home bucket */
+      U64 q = p ? p-1 : nSlot-1, bq = q / ms->nSlot ;
+      U128 kq ;
+      if (!modsetSlot (ms, q, &kq)) die ("%s: gap before slot %llu", what, p) ;
+      U64 dq = (bq - mixHome (ms, keyMix (ms, (U64) kq))) & ms->bucketMask ;
+      if (d > dq + (b != bq)) die ("%s: slot %llu has an earlier home than slot %llu", what, p, q) ;
+    }
+  if (nUsed != ms->max) die ("%s: %llu slots used for %u entries", what, nUsed, ms->max) ;
+  free (seen) ;
+}
+
+static void testCheck (char *what, Modset *ms, TestEntry *x) /* ms must hold exactly x */
+{
+  int p, s ;
+  U32 n = 0 ;
+  bucketCheck (what, ms) ;
+  U64 *value = modsetValues (ms) ;
+  for (p = 0 ; p < testN + testExtra ; ++p)
+    { U32 i = modsetIndexFindLong (ms, testPool[p], false) ;
+      if (!x[p].depth) { if (i) die ("%s: kmer %d should be absent", what, p) ; continue ; }
+      if (!i) die ("%s: kmer %d is missing", what, p) ;
+      ++n ;
+      if (msValue (ms, value, i) != testPool[p]) die ("%s: kmer %d has the wrong value", what, p) ;
+      if (msDepth (ms, i) != x[p].depth)
+	die ("%s: kmer %d depth %u not %llu", what, p, msDepth (ms, i), x[p].depth) ;
+      if (ms->info[i] != x[p].info) die ("%s: kmer %d info %x not %x", what, p, ms->info[i], x[p].info) ;
+      for (s = 0 ; s < TEST_SETS ; ++s)
+	if ((s < ms->nSample ? msSample (ms, i)[s] : 0) != x[p].sample[s])
+	  die ("%s: kmer %d sample %d depth %u not %u", what, p, s, msSample (ms, i)[s], x[p].sample[s]) ;
+    }
+  if (n != ms->max) die ("%s: %u entries not %u", what, ms->max, n) ;
+  free (value) ;
+  printf ("  %s: %u entries ok\n", what, n) ;
+}
+
+static Modset *testBuild (Seqhash *sh, TestEntry *x, int j, bool isAtomic, int nThreads)
+{ /* add each kmer of set j depth times in random order, counting into sample column j */
+  int p ;
+  U64 i, n = 0 ;
+  U32 nDistinct = 0 ;
+  for (p = 0 ; p < testN ; ++p) if (x[p].depth) { n += x[p].depth ; ++nDistinct ; }
+  int *add = new (n, int) ;
+  for (p = 0, n = 0 ; p < testN ; ++p) for (i = 0 ; i < x[p].depth ; ++i) add[n++] = p ;
+  for (i = n ; i > 1 ; --i) { U64 r = random() % i ; int t = add[i-1] ; add[i-1] = add[r] ; add[r] = t ; }
+  Modset *ms = modsetCreate (sh, 20, 0) ;
+  modsetSamples (ms, j+1) ;
+  if (isAtomic)
+    { modsetReserve (ms, nDistinct) ;
+#ifdef OMP
+#pragma omp parallel for num_threads(nThreads)
+#endif
+      for (i = 0 ; i < n ; ++i)
+	{ U32 index = modsetIndexFindAtomic (ms, testPool[add[i]], true) ;
+	  msDepthAddAtomic (ms, index) ;
+	  msSampleAddAtomic (ms, index, j) ;
+	}
+    }
+  else
+    for (i = 0 ; i < n ; ++i)
+      { U32 index = modsetIndexFindLong (ms, testPool[add[i]], true) ;
+	msDepthAdd (ms, index, 1) ;
+	msSampleAdd (ms, index, j, 1) ;
+      }
+  free (add) ;
+  for (p = 0 ; p < testN ; ++p)
+    if (x[p].depth) ms->info[modsetIndexFindLong (ms, testPool[p], false)] = x[p].info ;
+  if (x[0].depth)		/* kmer 0 is set to near saturation, so merges saturate */
+    { msDepthSet (ms, modsetIndexFindLong (ms, testPool[0], false), U32MAX - 5) ;
+      x[0].depth = U32MAX - 5 ;
+    }
+  return ms ;
+}
+
+static void testMergeExpect (TestEntry *x, TestEntry **xs, int n, bool isInfo) /* as mergeEntry() */
+{ int p, j, s ;
+  for (p = 0 ; p < testN + testExtra ; ++p)
+    for (j = 0 ; j < n ; ++j)
+      if (xs[j][p].depth)
+	{ U64 d = x[p].depth + xs[j][p].depth ; x[p].depth = d < U32MAX ? d : U32MAX ;
+	  int c = (x[p].info & 0x3) + (xs[j][p].info & 0x3) ; if (c > 3) c = 3 ;
+	  x[p].info = ((isInfo ? x[p].info : 0) & ~0x3) | c ;
+	  for (s = 0 ; s < TEST_SETS ; ++s)
+	    { U32 z = x[p].sample[s] + xs[j][p].sample[s] ; x[p].sample[s] = z < U16MAX ? z : U16MAX ; }
+	}
+}
+
+static char *testFile (int j, char *suffix)
+{ static char name[4][1024] ;
+  static int i = 0 ;
+  i = (i + 1) % 4 ;
+  sprintf (name[i], "%s.%d.%s", testStem, j, suffix) ;
+  return name[i] ;
 }
 
+static Modset *testRead (char *name)
+{ FILE *f = fopen (name, "r") ; if (!f) die ("failed to open %s", name) ;
+  Modset *ms = modsetRead (f) ; fclose (f) ;
+  return ms ;
+}
+
+static void testWrite (Modset *ms, char *name)
+{ FILE *f = fopen (name, "w") ; if (!f) die ("failed to open %s", name) ;
+  modsetWrite (ms, f) ; fclose (f) ;
+}
+
+static void testWriteV7 (Modset *ms, char *name) /* the format before slots held remainders */
+{ FILE *f = fopen (name, "w") ; if (!f) die ("failed to open %s", name) ;
+  U32 size = ms->max+1, *pairs, nBig = depthBigPairs (ms, &pairs) ;
+  U64 nsd = (U64)size * ms->nSample, *value = modsetValues (ms) ;
+  fwrite ("MSHSTv7",8,1,f) ; fwrite (&ms->tableBits,sizeof(int),1,f) ;
+  fwrite (&size,sizeof(U32),1,f) ; fwrite (&ms->load,sizeof(double),1,f) ;
+  seqhashWrite (ms->hasher, f) ;
+  fwrite (ms->bucket,sizeof(MsBucket),ms->nBucket,f) ; /* the old index, skipped on reading */
+  fwrite (value,sizeof(U64),size,f) ;
+  if (ms->valueHi) fwrite (ms->valueHi,sizeof(U64),size,f) ;
+  fwrite (ms->depth,sizeof(U8),size,f) ; fwrite (ms->info,sizeof(U8),size,f) ;
+  fwrite (&nBig,sizeof(U32),1,f) ; fwrite (pairs,2*sizeof(U32),nBig,f) ;
+  fwrite (&ms->nSample,sizeof(int),1,f) ; fwrite (ms->sampleDepth,sizeof(U16),nsd,f) ;
+  if (ferror (f)) die ("failed to write %s", name) ;
+  fclose (f) ; free (value) ; free (pairs) ;
+}
+
+static void testDestroy (Modset *ms) { seqhashDestroy (ms->hasher) ; modsetDestroy (ms) ; }
+
+static int u128Order (const void *a, const void *b)
+{ U128 x = *(U128*)a, y = *(U128*)b ; return (x < y) ? -1 : (x > y) ; }
+
+static void testSelect (MsRun **r, TestEntry **xs, int n, int nIn, int minIn, U32 min, U32 max)
+{
+  Modset *ms = modsetRunSelect (r, n, nIn, minIn, min, max) ;
+  if (!ms) die ("modsetRunSelect failed") ;
+  TestEntry *x = new0 (testN + testExtra, TestEntry) ;
+  int p, j ;
+  for (p = 0 ; p < testN ; ++p)
+    { int nPresent = 0, copy = 0 ;
+      bool isOut = false ;
+      for (j = 0 ; j < n ; ++j)
+	{ U64 d = xs[j][p].depth ;
+	  if (!d || d < min || (max && d >= max)) continue ;
+	  if (j >= nIn) { isOut = true ; continue ; }
+	  if (!nPresent++) x[p].info = xs[j][p].info & ~0x3 ;
+	  x[p].depth += d ; copy += xs[j][p].info & 0x3 ;
+	}
+      if (isOut || nPresent < minIn) { x[p].depth = 0 ; x[p].info = 0 ; continue ; }
+      if (x[p].depth > U32MAX) x[p].depth = U32MAX ;
+      x[p].info |= copy < 3 ? copy : 3 ;
+    }
+  char what[128] ; sprintf (what, "select %d of %d in, %d out, %u <= depth < %u", minIn, nIn, n-nIn, min, max) ;
+  testCheck (what, ms, x) ;
+  free (x) ; testDestroy (ms) ;
+}
+
+static void testAll (int k, int nPool, int nThreads)
+{
+  int p, j, i ;
+  U32 s ;
+  printf ("k %d pool %d threads %d\n", k, nPool, nThreads) ;
+
+  Seqhash *sh = seqhashCreate (k, 4, 7) ; /* small w so a short sequence gives many kmers */
+  testExtra = nPool + modsetMaxSize (sh, 20, MS_LOAD_MAX) ; /* so set 0 must grow when they are added */
+  int len = 5 * (nPool + testExtra) + k ;
+  char *seq = new (len, char) ;
+  for (i = 0 ; i < len ; ++i) seq[i] = random() & 3 ;
+  SeqhashBatch *sb = seqhashBatchCreate (1024) ;
+  int n = modRCbatch (sh, seq, len, sb) ;
+  testPool = new (n, U128) ;	/* distinct kmers, in random order */
+  for (i = 0 ; i < n ; ++i) testPool[i] = seqhashBatchKmer (sb, i) ;
+  qsort (testPool, n, sizeof(U128), u128Order) ;
+  for (i = 1, testN = n ? 1 : 0 ; i < n ; ++i)
+    if (testPool[i] != testPool[testN-1]) testPool[testN++] = testPool[i] ;
+  seqhashBatchDestroy (sb) ; free (seq) ;
+  for (i = testN ; i > 1 ; --i) { int r = random() % i ; U128 t = testPool[i-1] ; testPool[i-1] = testPool[r] ; testPool[r] = t ; }
+  if (testN < nPool + testExtra) die ("only %d kmers from the test sequence", testN) ;
+  testN = nPool ;
+
+  TestEntry *xs[TEST_SETS] ;	/* the depths of set j, with a few over MS_DEPTH_BIG and U16MAX */
+  for (j = 0 ; j < TEST_SETS ; ++j)
+    { xs[j] = new0 (testN + testExtra, TestEntry) ;
+      for (p = 0 ; p < testN ; ++p)
+	{ if (p && random() % 10 < 3) continue ;
+	  U64 d = 1 + random() % 4 ;
+	  if (!(random() % 50)) d = 200 + random() % 200 ;
+	  if (!(random() % 10000)) d = U16MAX + random() % 1000 ;
+	  xs[j][p].depth = d ;
+	  xs[j][p].sample[j] = d < U16MAX ? d : U16MAX ;
+	  xs[j][p].info = ((p + j) & 0x3) | ((p % 7 == j) ? MS_REPEAT : 0) ;
+	}
+    }
+  Modset *ms[TEST_SETS] ;
+  for (j = 0 ; j < TEST_SETS ; ++j)
+    { Seqhash *shj = new (1, Seqhash) ; *shj = *sh ;
+      ms[j] = testBuild (shj, xs[j], j, j == 1, nThreads) ;
+      char what[64] ; sprintf (what, "set %d %s", j, j == 1 ? "added in parallel" : "added serially") ;
+      testCheck (what, ms[j], xs[j]) ;
+    }
+  modsetLoad (ms[2], 0.9) ;	/* so the round trip checks the load */
+
+  for (j = 0 ; j < TEST_SETS ; ++j) /* round trips */
+    { testWrite (ms[j], testFile (j, "mod")) ;
+      Modset *mr = testRead (testFile (j, "mod")) ;
+      if (mr->tableBits != ms[j]->tableBits || mr->load != ms[j]->load || mr->nSample != ms[j]->nSample)
+	die ("set %d read back with different bits, load or samples", j) ;
+      testCheck ("compressed round trip", mr, xs[j]) ;
+      testDestroy (mr) ;
+      modsetWriteMap (ms[j], testFile (j, "map")) ;
+      mr = modsetOpen (testFile (j, "map")) ;
+      if (!mr->map || mr->tableBits != ms[j]->tableBits || mr->load != ms[j]->load)
+	die ("set %d map opened with different bits or load", j) ;
+      testCheck ("map round trip", mr, xs[j]) ;
+      U32 index = modsetIndexFindLong (mr, testPool[testN], true) ; /* unmaps it */
+      msDepthAdd (mr, index, 1) ;
+      xs[j][testN].depth = 1 ;
+      testCheck ("map after adding", mr, xs[j]) ;
+      xs[j][testN].depth = 0 ;
+      testDestroy (mr) ;
+    }
+
+  TestEntry *x = new0 (testN + testExtra, TestEntry) ; /* merges, in the order 0, 1, 2 */
+  testMergeExpect (x, xs, TEST_SETS, false) ;
+  Seqhash *shm = new (1, Seqhash) ; *shm = *sh ;
+  Modset *mm = modsetCreate (shm, 20, 0) ;
+  for (j = 0 ; j < TEST_SETS ; ++j) if (!modsetMerge (mm, ms[j])) die ("modsetMerge failed") ;
+  testCheck ("modsetMerge", mm, x) ;
+  testDestroy (mm) ;
+  shm = new (1, Seqhash) ; *shm = *sh ;
+  mm = modsetCreate (shm, 20, 0) ;
+  if (!modsetMergeMany (mm, ms, TEST_SETS, nThreads)) die ("modsetMergeMany failed") ;
+  testCheck ("modsetMergeMany into empty", mm, x) ;
+  testDestroy (mm) ;
+  mm = testRead (testFile (0, "mod")) ; /* into set 0, whose entries keep their indices */
+  U32 max0 = mm->max ;
+  U64 *v0 = modsetValues (mm), *v1 ;
+  if (!modsetMergeMany (mm, ms + 1, TEST_SETS - 1, nThreads)) die ("modsetMergeMany failed") ;
+  memcpy (x, xs[0], (testN + testExtra) * sizeof(TestEntry)) ;
+  testMergeExpect (x, xs + 1, TEST_SETS - 1, true) ;
+  testCheck ("modsetMergeMany into set 0", mm, x) ;
+  v1 = modsetValues (mm) ;
+  for (s = 1 ; s <= max0 ; ++s) if (v1[s] != v0[s]) die ("merge moved entry %u of set 0", s) ;
+  free (v0) ; free (v1) ;
+  testDestroy (mm) ;
+
+  mm = testRead (testFile (0, "mod")) ; /* prune, then a new entry must start from depth 0 */
+  modsetDepthPrune (mm, 2, 300) ;
+  memcpy (x, xs[0], (testN + testExtra) * sizeof(TestEntry)) ;
+  for (p = 0 ; p < testN ; ++p)
+    if (x[p].depth < 2 || x[p].depth >= 300) memset (&x[p], 0, sizeof(TestEntry)) ;
+  testCheck ("modsetDepthPrune", mm, x) ;
+  for (p = testN ; p < testN + testExtra ; p += 1000)
+    { msDepthAdd (mm, modsetIndexFindLong (mm, testPool[p], true), 1) ; x[p].depth = 1 ; }
+  testCheck ("adding after prune", mm, x) ;
+  testDestroy (mm) ;
+
+  if (!sh->link)		/* coarsen keeps the entries whose hash is divisible by 2w */
+    { mm = modsetCoarsen (ms[0], 1) ;
+      memcpy (x, xs[0], (testN + testExtra) * sizeof(TestEntry)) ;
+      for (p = 0 ; p < testN ; ++p)
+	if (seqhashLevel (sh, seqhashKmer (sh, testPool[p])) < 1) memset (&x[p], 0, sizeof(TestEntry)) ;
+      testCheck ("modsetCoarsen", mm, x) ;
+      testDestroy (mm) ;
+    }
+
+  mm = testRead (testFile (0, "mod")) ; /* kmers come back from the slots through growth */
+  memcpy (x, xs[0], (testN + testExtra) * sizeof(TestEntry)) ;
+  int bits = mm->tableBits ;
+  for (p = testN ; p < testN + testExtra ; ++p)
+    { msDepthAdd (mm, modsetIndexFindLong (mm, testPool[p], true), 2) ; x[p].depth = 2 ; }
+  if (mm->tableBits == bits) die ("adding %d kmers did not grow the table from %d bits", testExtra, bits) ;
+  char what[64] ; sprintf (what, "kmers after growth from %d to %d bits", bits, mm->tableBits) ;
+  testCheck (what, mm, x) ;
+  testDestroy (mm) ;
+
+  testWriteV7 (ms[1], testFile (1, "v7")) ; /* the v7 format, with value[], is read into slots */
+  mm = testRead (testFile (1, "v7")) ;
+  testCheck ("v7 read into slots", mm, xs[1]) ;
+  testDestroy (mm) ;
+  unlink (testFile (1, "v7")) ;
+
+  MsRun *r[TEST_SETS] ;		/* set operations via sorted runs */
+  for (j = 0 ; j < TEST_SETS ; ++j) r[j] = modsetRunOpen (testFile (j, "mod")) ;
+  testSelect (r, xs, TEST_SETS, TEST_SETS, 1, 0, 0) ; /* union */
+  testSelect (r, xs, TEST_SETS, TEST_SETS, TEST_SETS, 0, 0) ; /* intersection */
+  testSelect (r, xs, TEST_SETS, 1, 1, 0, 0) ;	/* 0 minus the rest */
+  testSelect (r, xs, TEST_SETS, 2, 2, 2, 300) ; /* in 0 and 1 not 2, filtering depth */
+  U64 shared[TEST_SETS*TEST_SETS], expect[TEST_SETS*TEST_SETS] ;
+  int a, b, t, nT[2] = { 1, nThreads } ;
+  memset (expect, 0, sizeof(expect)) ;
+  for (p = 0 ; p < testN ; ++p)
+    for (a = 0 ; a < TEST_SETS ; ++a)
+      for (b = 0 ; b < TEST_SETS ; ++b)
+	if (xs[a][p].depth >= 2 && xs[b][p].depth >= 2) ++expect[a*TEST_SETS+b] ;
+  for (t = 0 ; t < 2 ; ++t)
+    { if (!modsetRunShared (r, TEST_SETS, 2, 0, shared, nT[t])) die ("modsetRunShared failed") ;
+      if (memcmp (shared, expect, sizeof(shared))) die ("modsetRunShared with %d threads is wrong", nT[t]) ;
+    }
+  printf ("  modsetRunShared: ok, Jaccard") ;
+  for (a = 0 ; a < TEST_SETS ; ++a)
+    for (b = a+1 ; b < TEST_SETS ; ++b)
+      printf (" %d-%d %.4f", a, b, shared[a*TEST_SETS+b] /
+	      (double)(shared[a*TEST_SETS+a] + shared[b*TEST_SETS+b] - shared[a*TEST_SETS+b])) ;
+  putchar ('\n') ;
+
+  for (j = 0 ; j < TEST_SETS ; ++j)
+    { modsetRunClose (r[j]) ;
+      unlink (testFile (j, "mod")) ; unlink (testFile (j, "mod.srt")) ; unlink (testFile (j, "map")) ;
+      testDestroy (ms[j]) ; free (xs[j]) ;
+    }
+  free (x) ; free (testPool) ; seqhashDestroy (sh) ;
+}
+
+int main (int argc, char *argv[])
+{
+  int k = argc > 1 ? atoi(argv[1]) : 19 ;
+  int nPool = argc > 2 ? atoi(argv[2]) : 400000 ;
+  int nThreads = argc > 3 ? atoi(argv[3]) : 4 ;
+  if (k < 1 || k > 64 || nPool < 1000 || nThreads < 1) die ("usage: modset [k] [nPool] [nThreads]") ;
+  char stem[64] ; sprintf (stem, "/tmp/modsetTEST.%d", (int) getpid ()) ;
+  testStem = stem ;
+  srandom (17) ;
+  testAll (k, nPool, nThreads) ;
+  printf ("all ok\n") ;
+}
+
+#endif
+
 /***************************************************/
@@ -13,33 +13,165 @@
 #include "utils.h"
 #include "seqhash.h"
 
+/* 64 byte bucket of the primary table, with packed slots - see modset.c */
+#define MS_BUCKET_BITS 480	/* bits for slots, below the version in the top of word[7] */
+typedef struct {
+  U64 word[8] ;
+} MsBucket ;
+
 /* object to hold sets of modimizers */
 typedef struct {
   Seqhash *hasher ;
   int tableBits ;		/* max 34 so size < 2^32 so index is 32bit */
-  U32 size ;			/* size of value array, and other arrays over this set */
+  U32 size ;			/* size of depth, info and other arrays over this set */
   U64 tableSize ; 		/* = 1 << tableBits */
-  U64 tableMask ;		/* = tableSize - 1 */
-  U32 *index ;			/* this is the primary table - size tableSize */
-  U64 *value ;			/* the kmer values */
-  U16 *depth ;			/* depth at each index */
+  U64 nBucket ;			/* = tableSize / 16 */
+  U64 bucketMask ;		/* = nBucket - 1 */
+  int keyBits ;			/* bits of key hashed to place a kmer: 2k, or 64 if k > 31 or linked */
+  U64 keyMask ;
+  int mixShift ;		/* for the invertible mix of the key - see modset.c */
+  int remBits ;			/* bits of the mixed key not given by the home bucket, kept in slots */
+  int homeUp ;			/* the home bucket is (mixed key >> remBits) << homeUp */
+  int indexBits ;		/* bits of index in a slot, enough for every slot */
+  int slotBits ;		/* indexBits + MS_DISP_BITS + remBits */
+  int nSlot ;			/* slots per bucket = MS_BUCKET_BITS / slotBits */
+  MsBucket *bucket ;		/* this is the primary table - size nBucket */
+  U64 *valueHi ;		/* high 64 bits of the kmers if hasher->k > 31, else 0 */
+  U8  *depth ;			/* depth at each index, MS_DEPTH_BIG if it is in depthBig - use msDepth() */
   U8  *info ;			/* bits for various things */
+  int nSample ;			/* number of per-sample depths per entry, 0 if none */
+  U16 *sampleDepth ;		/* nSample per entry, so a kmer's are together - use msSample() */
   U32 max ;			/* number of entries in the set - must be less than size */
+  U32 lock ;			/* held while adding in modsetIndexFindAtomic(), and for depthBig */
+  HASH depthHash ;		/* index -> place in depthBig, for depth >= MS_DEPTH_BIG, else 0 */
+  Array depthBig ;		/* of U32 */
+  double load ;			/* the table doubles when entries would pass this fraction of slots */
+  char *map ;			/* if set, the arrays above are in this mmap of a file */
+  U64 mapSize ;
 } Modset ;
 
+/* Kmers are not stored in full: a slot holds the index and the bits of the kmer not implied by
+   its home bucket, from which the kmer is recovered - see modset.c.  A slot is 2k+10 bits
+   for k <= 31, e.g. 48 at k 19, so 10 in a 64 byte bucket, and 74 bits for k > 31 or linked
+   seeds, so 6 per bucket.  load is the fraction of slots that may be filled, so at k 19 the
+   table takes 8.0 bytes per entry at the default 0.8, 7.1 at 0.9 and 6.7 at 0.95, against 24
+   for the 16 byte index and 8 byte value before.  On top of that depth and info take 2 bytes
+   per entry, plus 8 for valueHi if k > 31, and 2 per sample if there are samples.
+*/
+#define MS_LOAD_DEFAULT 0.8
+#define MS_LOAD_MAX 0.95
+U32 modsetMaxSize (Seqhash *sh, int bits, double load) ; /* largest size for a 2^bits table */
+
+/* Modsets grow as entries are added, so bits and size are only starting values - size 0 for
+   the default, which is at most MS_SIZE_START.  A given size is kept, e.g. when reading.
+*/
+#define MS_SIZE_START (1 << 20)
 Modset *modsetCreate (Seqhash *sh, int bits, U32 size) ;
+void modsetReserve (Modset *ms, U64 n) ; /* make room for n more entries */
+void modsetLoad (Modset *ms, double load) ; /* set ms->load, growing the table if needed */
 void modsetDestroy (Modset *ms) ; 
 void modsetWrite (Modset *ms, FILE *f) ;
 Modset *modsetRead (FILE *f) ;
+// map format files are page-aligned and uncompressed, and modsetOpen() mmaps them lazily,
+// sharing pages between processes until they are written to - see modset.c
+void modsetWriteMap (Modset *ms, char *filename) ;
+Modset *modsetOpen (char *filename) ; /* opens either format */
+void modsetUnmap (Modset *ms) ;	      /* copy a mapped Modset into memory - done before growing */
 
 /* this is the key low level function, both to insert new hashes and find existing ones */
 U32 modsetIndexFind (Modset *ms, U64 kmer, int isAdd) ;
+U32 modsetIndexFindLong (Modset *ms, U128 kmer, int isAdd) ; /* works for any k, needed if k > 31 */
+U32 modsetIndexFindAtomic (Modset *ms, U128 kmer, int isAdd) ; /* thread-safe, any k */
+static inline U64 modsetSlots (Modset *ms) { return ms->nBucket * ms->nSlot ; }
+U32 modsetSlot (Modset *ms, U64 p, U128 *kmer) ;
+  /* index of the entry in slot p < modsetSlots(), 0 if empty, setting *kmer if kmer != 0 */
+U64 *modsetValues (Modset *ms) ; /* new array of the low 64 bits of the kmers by index - free it */
+static inline U128 msValue (Modset *ms, U64 *value, U32 i) /* kmer i, with value from modsetValues() */
+{ return ms->valueHi ? ((U128)ms->valueHi[i] << 64) | value[i] : value[i] ; }
+static inline U32 modsetIndexFindHit (Modset *ms, SeqhashBatch *sb, int i, int isAdd) /* hit i of sb */
+{ return ms->valueHi ? modsetIndexFindLong (ms, seqhashBatchKmer (sb, i), isAdd)
+                     : modsetIndexFind (ms, sb->kmer[i], isAdd) ;
+}
+void modsetIndexFindBatch (Modset *ms, SeqhashBatch *sb, int isAdd) ;
+  /* sets sb->index[i] for all sb->n hits, as modsetIndexFindHit() in order, but prefetching */
+
+/* Depths are exact up to U32MAX, where they saturate.  ms->depth[] holds those below
+   MS_DEPTH_BIG, and the rest are in a hash on the side, so always go through these.
+*/
+#define MS_DEPTH_BIG U8MAX
+U32 msDepthBig (Modset *ms, U32 i) ;	       /* these three are thread-safe for different i */
+void msDepthSetBig (Modset *ms, U32 i, U32 d) ;
+void msDepthAddAtomicBig (Modset *ms, U32 i) ;
+static inline U32 msDepth (Modset *ms, U32 i)
+{ return ms->depth[i] < MS_DEPTH_BIG ? ms->depth[i] : msDepthBig (ms, i) ; }
+static inline void msDepthSet (Modset *ms, U32 i, U32 d)
+{ if (d < MS_DEPTH_BIG) ms->depth[i] = d ; else msDepthSetBig (ms, i, d) ; }
+static inline void msDepthAdd (Modset *ms, U32 i, U32 n)
+{ if (n < MS_DEPTH_BIG - ms->depth[i]) ms->depth[i] += n ;
+  else { U64 d = (U64) msDepth (ms, i) + n ; msDepthSetBig (ms, i, d < U32MAX ? d : U32MAX) ; }
+}
+static inline void msDepthAddAtomic (Modset *ms, U32 i) /* thread-safe ++depth */
+{ U8 d = __atomic_load_n (&ms->depth[i], __ATOMIC_RELAXED) ;
+  while (d < MS_DEPTH_BIG-1 && !__atomic_compare_exchange_n (&ms->depth[i], &d, d+1, true,
+							      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+  if (d >= MS_DEPTH_BIG-1) msDepthAddAtomicBig (ms, i) ;
+}
+
+/* Optionally a Modset also counts several samples at once, with a vector of nSample U16 depths
+   per entry, saturating at U16MAX, while depth[] holds their total.  Merges add the vectors.
+*/
+void modsetSamples (Modset *ms, int nSample) ; /* make room for nSample, new ones with depth 0 */
+static inline U16 *msSample (Modset *ms, U32 i) { return ms->sampleDepth + (U64)i * ms->nSample ; }
+static inline void msSampleAdd (Modset *ms, U32 i, int s, U32 n)
+{ U16 *d = msSample (ms, i) + s ; *d = (n < U16MAX - *d) ? *d + n : U16MAX ; }
+static inline void msSampleAddAtomic (Modset *ms, U32 i, int s) /* thread-safe ++ */
+{ U16 *p = msSample (ms, i) + s, d = __atomic_load_n (p, __ATOMIC_RELAXED) ;
+  while (d < U16MAX && !__atomic_compare_exchange_n (p, &d, d+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+}
 
 /* the following act on the whole set */
 void modsetSummary (Modset *ms, FILE *f) ;
-bool modsetPack (Modset *ms)	; /* reduce size to max+1 and compress value; TRUE if changes */
+bool modsetPack (Modset *ms)	; /* reduce size to max+1; TRUE if changes */
 void modsetDepthPrune (Modset *ms, int min, int max) ;
 bool modsetMerge (Modset *ms1, Modset *ms2) ;
+bool modsetMergeMany (Modset *ms, Modset **ms2, int n, int nThreads) ; /* as modsetMerge() of each */
+bool modsetConcat (Modset *ms1, Modset *ms2) ; /* as modsetMerge() if no kmer is in both */
+static inline int modsetShard (U128 kmer, int n) /* in 0..n-1, for splitting a count over n jobs */
+{ return ((((U64)kmer + (U64)(kmer >> 64)) * 0x9e3779b97f4a7c15ULL) >> 32) % n ; }
+Modset *modsetCoarsen (Modset *ms, int j) ; /* new Modset of the entries at density w << j */
+
+/* Set operations go by merging the kmer-sorted runs of several Modsets, streamed from files
+   cached beside each mod file as <mod file>.srt - see modset.c
+*/
+typedef struct {
+  U64 lo, hi ;			/* the kmer, hi 0 if k <= 31 - runs are sorted by (hi, lo) */
+  U32 depth ;
+  U8 info ;
+} MsRunEntry ;
+
+typedef struct {
+  Seqhash *hasher ;
+  int fd ;
+  U64 n ;			/* number of entries */
+} MsRun ;
+
+typedef struct {		/* a stream through entries i..iEnd-1 of a run - any number per run */
+  MsRun *r ;
+  U64 i, iEnd ;
+  MsRunEntry *buf ;
+  int nBuf, iBuf ;
+} MsRunStream ;
+
+MsRun *modsetRunOpen (char *filename) ; /* makes the .srt file if it is missing or out of date */
+void modsetRunClose (MsRun *r) ;
+U64 modsetRunFind (MsRun *r, U128 kmer) ; /* index of the first entry >= kmer */
+MsRunStream *modsetRunStream (MsRun *r, U64 start, U64 end) ;
+MsRunEntry *modsetRunNext (MsRunStream *s) ; /* 0 at the end - only valid until the next call */
+void modsetRunStreamDestroy (MsRunStream *s) ;
+Modset *modsetRunSelect (MsRun **r, int n, int nIn, int minIn, U32 min, U32 max) ;
+  /* kmers in >= minIn of r[0..nIn-1] and none of r[nIn..n-1], with min <= depth < max in each */
+bool modsetRunShared (MsRun **r, int n, U32 min, U32 max, U64 *shared, int nThreads) ;
+  /* n*n matrix of the numbers of kmers in both of each pair, in parallel */
 
 /* info fields */
 /* bits 1 and 2 for copy number in {0,1,2,M} with 0 for errors */
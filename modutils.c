@@ -12,99 +12,577 @@
 
 #include "modset.h"
 #include "seqio.h"
+#include "bloom.h"
+#include <unistd.h>		/* getpid(), unlink() */
 
+#ifdef OMP
+#include <omp.h>
+#endif
+
+int numThreads = 1 ;		/* default to serial - reset if multi-threaded */
 FILE *outFile ;
 bool isVerbose = false ;
+double load = MS_LOAD_DEFAULT ;	/* fraction of index slots filled before the table doubles */
+int shard = 0, nShard = 1 ;	/* count only the kmers with modsetShard (kmer, nShard) == shard */
+int sample = -1 ;		/* if >= 0 also count into this sample's depth column */
+
+/* With a Bloom filter, -a and -x only add a kmer to the Modset when it is seen for the second
+   time, so most of the error kmers, which are seen once, don't take space there.  The first
+   sighting is added back to the depth of each new entry at the end of the file, so depths are
+   exact except when the first sighting was a false positive of the filter, when they are one
+   too high.
+*/
+
+Bloom *bloom = 0 ;
+
+static inline U64 bloomKey (U128 kmer)
+{ return (U64)kmer ^ ((U64)(kmer >> 64) * 0x9e3779b97f4a7c15ULL) ; }
+
+static int shardFilter (SeqhashBatch *sb) /* keep the hits of sb in our shard, return new sb->n */
+{
+  int i, n = 0 ;
+  for (i = 0 ; i < sb->n ; ++i)
+    if (modsetShard (seqhashBatchKmer (sb, i), nShard) == shard)
+      { sb->kmer[n] = sb->kmer[i] ; if (sb->kmerHi) sb->kmerHi[n] = sb->kmerHi[i] ;
+	sb->pos[n] = sb->pos[i] ; sb->isF[n] = sb->isF[i] ;
+	++n ;
+      }
+  return sb->n = n ;
+}
 
-static int addSequence (Modset *ms, char *s, int len) /* return number of hashes */
+static int addSequence (Modset *ms, SeqhashBatch *sb, SeqIO *si, int start) /* return number of hashes */
 {
-  int nHash = 0 ;
-  SeqhashRCiterator *mi = modRCiterator (ms->hasher, s, len) ;
-  U64 kmer ; int pos ;
-  while (modRCnext (mi, &kmer, &pos, 0))
-    { U32 index = modsetIndexFind (ms, kmer, true) ;
-      U16 *di = &ms->depth[index] ; ++*di ; if (!*di) *di = U16MAX ;
-      ++nHash ;
+  int i, nHash = si->isPacked ?
+    modRCbatchPacked (ms->hasher, sqioSeqPacked(si), start, si->seqLen - start, sb) :
+    modRCbatch (ms->hasher, sqioSeq(si) + start, si->seqLen - start, sb) ;
+  if (nShard > 1) nHash = shardFilter (sb) ;
+  modsetIndexFindBatch (ms, sb, !bloom) ;
+  for (i = 0 ; i < nHash ; ++i)
+    { U32 index = sb->index[i] ;
+      if (!index && bloomAdd (bloom, bloomKey (seqhashBatchKmer (sb, i))))
+	index = modsetIndexFindHit (ms, sb, i, true) ;
+      if (!index) continue ;
+      msDepthAdd (ms, index, 1) ;
+      if (sample >= 0) msSampleAdd (ms, index, sample, 1) ;
     }
-  seqhashRCiteratorDestroy (mi) ;
   return nHash ;
 }
 
+/* For counting in parallel, sequences are read serially into blocks of about ADD_BLOCK bytes,
+   then each block is split over the threads in two passes.  The first looks up each hash
+   without adding, adding to the depth of those found and keeping the rest in a per-thread
+   miss array.  The second pass adds the misses with the thread-safe modsetIndexFindAtomic(),
+   which can't grow the Modset, so they go in rounds of no more than the table has room for,
+   growing it between rounds.  Depths are as for the serial version but the order of entries
+   in the Modset depends on thread timing.
+*/
+
+#define ADD_BLOCK (1 << 26)
+
+typedef struct { U64 off ; int len, start ; } BlockSeq ;
+
+static inline void addHitAtomic (Modset *ms, U32 index)
+{
+  msDepthAddAtomic (ms, index) ;
+  if (sample >= 0) msSampleAddAtomic (ms, index, sample) ;
+}
+
+static U64 addBlock (Modset *ms, SeqhashBatch **sbs, Array *miss, Array data, Array seqs, bool isPacked)
+{
+  int j, t ;
+  U64 nHash = 0 ;
+  for (t = 0 ; t < numThreads ; ++t) arrayMax(miss[t]) = 0 ;
+#ifdef OMP
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:nHash)
+#endif
+  for (j = 0 ; j < arrayMax(seqs) ; ++j)
+    { BlockSeq *b = arrp(seqs, j, BlockSeq) ;
+      int i, t = 0 ;
+#ifdef OMP
+      t = omp_get_thread_num () ;
+#endif
+      SeqhashBatch *sb = sbs[t] ;
+      char *s = arrp(data, b->off, char) ;
+      int n = isPacked ? modRCbatchPacked (ms->hasher, (U8*)s, b->start, b->len - b->start, sb) :
+	modRCbatch (ms->hasher, s + b->start, b->len - b->start, sb) ;
+      if (nShard > 1) n = shardFilter (sb) ;
+      for (i = 0 ; i < n ; ++i)
+	{ U128 kmer = seqhashBatchKmer (sb, i) ;
+	  U32 index = modsetIndexFindAtomic (ms, kmer, false) ;
+	  if (index) addHitAtomic (ms, index) ;
+	  else if (!bloom || bloomAddAtomic (bloom, bloomKey (kmer)))
+	    array(miss[t], arrayMax(miss[t]), U128) = kmer ;
+	}
+      nHash += n ;
+    }
+  Array m = miss[0] ;		/* gather the misses here */
+  for (t = 1 ; t < numThreads ; ++t)
+    if (arrayMax(miss[t]))
+      { int n0 = arrayMax(m) ;
+	memcpy (arrayBlock (m, n0, arrayMax(miss[t]), U128), arrp(miss[t], 0, U128),
+		arrayMax(miss[t])*sizeof(U128)) ;
+	arrayMax(m) = n0 + arrayMax(miss[t]) ; /* arrayBlock() sets it one beyond */
+      }
+  U64 i = 0, nMiss = arrayMax(m) ;
+  while (i < nMiss)		/* in rounds that fit the table, which can't grow in parallel */
+    { U64 k, room = modsetMaxSize (ms->hasher, ms->tableBits, ms->load) - (U64)ms->max - 1 ;
+      if (!room)
+	{ modsetReserve (ms, 1) ; /* grows the table, as for the serial add */
+	  room = modsetMaxSize (ms->hasher, ms->tableBits, ms->load) - (U64)ms->max - 1 ;
+	}
+      U64 n = (nMiss - i < room) ? nMiss - i : room ;
+      modsetReserve (ms, n) ;	/* each miss adds at most one entry */
+#ifdef OMP
+#pragma omp parallel for schedule(static, 4096)
+#endif
+      for (k = i ; k < i + n ; ++k)
+	addHitAtomic (ms, modsetIndexFindAtomic (ms, arr(m, k, U128), true)) ;
+      i += n ;
+    }
+  return nHash ;
+}
+
+static U64 addSequenceFileThreads (Modset *ms, SeqIO *si, bool is10x, U64 *nSeq, U64 *totLen)
+{
+  int t ;
+  U64 totHash = 0, dataLen = 0 ;
+  SeqhashBatch **sbs = new (numThreads, SeqhashBatch*) ;
+  Array *miss = new (numThreads, Array) ;
+  for (t = 0 ; t < numThreads ; ++t)
+    { sbs[t] = seqhashBatchCreate (1024) ; miss[t] = arrayCreate (1 << 16, U128) ; }
+  Array data = arrayCreate (ADD_BLOCK + (1 << 20), char) ;
+  Array seqs = arrayCreate (1 << 16, BlockSeq) ;
+  while (seqIOread (si))
+    { ++*nSeq ; *totLen += si->seqLen ;
+      U64 n = si->isPacked ? (si->seqLen + 3) / 4 : si->seqLen ;
+      BlockSeq *b = arrayp(seqs, arrayMax(seqs), BlockSeq) ;
+      b->off = dataLen ; b->len = si->seqLen ; b->start = (is10x && (*nSeq & 0x1)) ? 23 : 0 ;
+      memcpy (arrayBlock (data, dataLen, n, char), si->isPacked ? (char*)sqioSeqPacked(si) : sqioSeq(si), n) ;
+      dataLen += n ;
+      if (dataLen >= ADD_BLOCK)
+	{ totHash += addBlock (ms, sbs, miss, data, seqs, si->isPacked) ;
+	  dataLen = 0 ; arrayMax(seqs) = 0 ;
+	}
+    }
+  if (arrayMax(seqs)) totHash += addBlock (ms, sbs, miss, data, seqs, si->isPacked) ;
+  for (t = 0 ; t < numThreads ; ++t) { seqhashBatchDestroy (sbs[t]) ; arrayDestroy (miss[t]) ; }
+  free (sbs) ; free (miss) ; arrayDestroy (data) ; arrayDestroy (seqs) ;
+  return totHash ;
+}
+
 static bool addSequenceFile (Modset *ms, char *filename, bool is10x)
 {
   char *seq ;			/* ignore the name for now */
   int len ;
   U64 nSeq = 0, totLen = 0, totHash = 0 ;
 
-  dna2indexConv['N'] = dna2indexConv['n'] = 0 ; /* to get 2-bit encoding */
   SeqIO *si = seqIOopenRead (filename, dna2indexConv, false) ; /* false for no qualities */
   if (!si) return false ;
-  while (seqIOread (si))
-    { ++nSeq ; totLen += si->seqLen ;
-      if (is10x && (nSeq & 0x1)) totHash += addSequence (ms, sqioSeq(si)+23, si->seqLen-23) ;
-      else totHash += addSequence (ms, sqioSeq(si), si->seqLen) ;
+  if (bloom && sample >= 0) die ("can't count samples with -b, which loses the sample of first sightings") ;
+  if (si->type == BINARY) si->isPacked = true ; /* hash directly from the packed sequence */
+  U32 i, max0 = ms->max ;
+  if (numThreads > 1)
+    totHash = addSequenceFileThreads (ms, si, is10x, &nSeq, &totLen) ;
+  else
+    { SeqhashBatch *sb = seqhashBatchCreate (1024) ; /* reused for every sequence */
+      while (seqIOread (si))
+	{ ++nSeq ; totLen += si->seqLen ;
+	  if (is10x && (nSeq & 0x1)) totHash += addSequence (ms, sb, si, 23) ;
+	  else totHash += addSequence (ms, sb, si, 0) ;
+	}
+      seqhashBatchDestroy (sb) ;
     }
   seqIOclose (si) ;
+  if (bloom)			/* add the first sighting, which only went into the filter */
+    { for (i = max0 + 1 ; i <= ms->max ; ++i) msDepthAdd (ms, i, 1) ;
+      if (isVerbose) fprintf (outFile, "Bloom filter fill %.3f\n", bloomFill (bloom)) ;
+    }
   fprintf (outFile, "added %llu sequences total length %llu total hashes %llu, new max %u\n",
 	   nSeq, totLen, totHash, ms->max) ;
   return true ;
 }
 
+/* External counting, for when the distinct kmers in a read set don't fit in memory.  The kmers
+   are spilled by the top bits of a hash into EXT_PARTS partition files in tmpDir.  Then each
+   partition is read back, sorted and counted, in parallel if -t > 1, and the kmers seen at
+   least min times are added to the Modset.  A partition bigger than its thread's share of
+   maxMem is first split again by the next bits of the hash.  With min 2, most error kmers
+   never reach the Modset.
+*/
+
+#define EXT_BITS 8
+#define EXT_PARTS (1 << EXT_BITS)
+#define EXT_BUF 4096		/* U64 words buffered per partition */
+
+char *tmpDir = "/tmp" ;
+double maxMem = 8 ;		/* GB for sorting partitions in -ae, not counting the Modset */
+
+typedef struct {
+  int nWord ;			/* U64 words per kmer: 1, or 2 if k > 31 */
+  FILE *f[EXT_PARTS] ;
+  U64 *buf[EXT_PARTS] ;
+  int n[EXT_PARTS] ;
+} ExtParts ;
+
+static ExtParts *extCreate (char *name, int nWord) /* opens files name.0 ... name.255 */
+{
+  ExtParts *ep = new0 (1, ExtParts) ;
+  ep->nWord = nWord ;
+  char partName[strlen(name)+8] ;
+  int p ;
+  for (p = 0 ; p < EXT_PARTS ; ++p)
+    { sprintf (partName, "%s.%d", name, p) ;
+      if (!(ep->f[p] = fopen (partName, "w"))) die ("failed to open temporary file %s", partName) ;
+      ep->buf[p] = new (EXT_BUF, U64) ;
+    }
+  return ep ;
+}
+
+static void extFlush (ExtParts *ep, int p)
+{ if (ep->n[p] && fwrite (ep->buf[p], sizeof(U64), ep->n[p], ep->f[p]) != ep->n[p])
+    die ("failed to write temporary file - is %s full?", tmpDir) ;
+  ep->n[p] = 0 ;
+}
+
+static void extDestroy (ExtParts *ep) /* flushes and closes the files */
+{ int p ;
+  for (p = 0 ; p < EXT_PARTS ; ++p)
+    { extFlush (ep, p) ; fclose (ep->f[p]) ; free (ep->buf[p]) ; }
+  free (ep) ;
+}
+
+static inline void extPut (ExtParts *ep, U64 *x, int level) /* x is nWord long */
+{ U64 h = (x[0] + (ep->nWord > 1 ? x[1] : 0)) * 0x9e3779b97f4a7c15ULL ;
+  int p = (h >> (64 - EXT_BITS*(level+1))) & (EXT_PARTS-1) ;
+  if (ep->n[p] + ep->nWord > EXT_BUF) extFlush (ep, p) ;
+  U64 *b = ep->buf[p] + ep->n[p] ;
+  *b = x[0] ; if (ep->nWord > 1) b[1] = x[1] ;
+  ep->n[p] += ep->nWord ;
+}
+
+static int extOrder (const void *a, const void *b)
+{ U64 x = *(U64*)a, y = *(U64*)b ; return (x < y) ? -1 : (x > y) ; }
+
+static int extOrderLong (const void *a, const void *b)
+{ U64 *x = (U64*)a, *y = (U64*)b ;
+  if (x[1] != y[1]) return (x[1] < y[1]) ? -1 : 1 ;
+  return (x[0] < y[0]) ? -1 : (x[0] > y[0]) ;
+}
+
+static inline bool extSame (U64 *x, U64 *y, int nWord)
+{ return *x == *y && (nWord == 1 || x[1] == y[1]) ; }
+
+static U64 extCount (Modset *ms, char *name, int nWord, int level, int min, U64 memMax)
+/* counts the kmers in partition file name, adding them to ms; returns the number added */
+{
+  FILE *f = fopen (name, "r") ;
+  if (!f) die ("failed to reopen temporary file %s", name) ;
+  fseek (f, 0, SEEK_END) ;
+  U64 n = ftell (f) / (nWord * sizeof(U64)) ; /* number of kmers */
+  rewind (f) ;
+  U64 nAdded = 0 ;
+
+  if (n * nWord * sizeof(U64) > memMax && level + 1 < 64 / EXT_BITS) /* split it again */
+    { U64 *x = new (EXT_BUF, U64) ;
+      size_t i, m ;
+#ifdef OMP
+#pragma omp critical (extSplit)	/* one split at a time, to bound the number of open files */
+#endif
+      { ExtParts *ep = extCreate (name, nWord) ;
+	while ((m = fread (x, nWord * sizeof(U64), EXT_BUF / nWord, f)) > 0)
+	  for (i = 0 ; i < m ; ++i) extPut (ep, x + i*nWord, level+1) ;
+	extDestroy (ep) ;
+      }
+      free (x) ; fclose (f) ; unlink (name) ;
+      char partName[strlen(name)+8] ;
+      int p ;
+      for (p = 0 ; p < EXT_PARTS ; ++p)
+	{ sprintf (partName, "%s.%d", name, p) ;
+	  nAdded += extCount (ms, partName, nWord, level+1, min, memMax) ;
+	}
+      return nAdded ;
+    }
+
+  U64 *x = new (n * nWord + 1, U64), i, j ;
+  if (fread (x, nWord * sizeof(U64), n, f) != n) die ("failed to read temporary file %s", name) ;
+  fclose (f) ; unlink (name) ;
+  qsort (x, n, nWord * sizeof(U64), nWord > 1 ? extOrderLong : extOrder) ;
+  U64 nKeep = 0 ;		/* count first, so as to reserve space in ms */
+  for (i = 0 ; i < n ; i = j)
+    { j = i+1 ; while (j < n && extSame (x+i*nWord, x+j*nWord, nWord)) ++j ;
+      if (j - i >= min) ++nKeep ;
+    }
+#ifdef OMP
+#pragma omp critical (extAdd)	/* modsetIndexFind() is not thread-safe when the Modset grows */
+#endif
+  { modsetReserve (ms, nKeep) ;
+    for (i = 0 ; i < n ; i = j)
+      { j = i+1 ; while (j < n && extSame (x+i*nWord, x+j*nWord, nWord)) ++j ;
+	if (j - i < min) continue ;
+	U128 kmer = (nWord > 1) ? ((U128)x[i*nWord+1] << 64) | x[i*nWord] : x[i] ;
+	U32 index = modsetIndexFindLong (ms, kmer, true) ;
+	msDepthAdd (ms, index, j - i) ;
+	if (sample >= 0) msSampleAdd (ms, index, sample, j - i) ;
+	++nAdded ;
+      }
+  }
+  free (x) ;
+  return nAdded ;
+}
+
+static bool addSequenceFileExternal (Modset *ms, char *filename, int min)
+{
+  U64 nSeq = 0, totLen = 0, totHash = 0, nAdded = 0 ;
+  SeqIO *si = seqIOopenRead (filename, dna2indexConv, false) ; /* false for no qualities */
+  if (!si) return false ;
+  if (si->type == BINARY) si->isPacked = true ;
+
+  int nWord = ms->valueHi ? 2 : 1 ;
+  char stem[strlen(tmpDir)+32] ;
+  sprintf (stem, "%s/modutils.%d", tmpDir, (int) getpid ()) ;
+  ExtParts *ep = extCreate (stem, nWord) ;
+  SeqhashBatch *sb = seqhashBatchCreate (1024) ;
+  while (seqIOread (si))
+    { ++nSeq ; totLen += si->seqLen ;
+      int i, n = si->isPacked ?
+	modRCbatchPacked (ms->hasher, sqioSeqPacked(si), 0, si->seqLen, sb) :
+	modRCbatch (ms->hasher, sqioSeq(si), si->seqLen, sb) ;
+      if (nShard > 1) n = shardFilter (sb) ;
+      for (i = 0 ; i < n ; ++i)
+	{ U64 x[2] = { sb->kmer[i], sb->kmerHi ? sb->kmerHi[i] : 0 } ;
+	  extPut (ep, x, 0) ;
+	}
+      totHash += n ;
+    }
+  seqhashBatchDestroy (sb) ;
+  seqIOclose (si) ;
+  extDestroy (ep) ;
+  if (isVerbose) { fprintf (outFile, "spilled %llu hashes to %s.*\n", totHash, stem) ; timeUpdate (outFile) ; }
+
+  U64 memMax = maxMem * (1 << 30) / numThreads ;
+  int p ;
+#ifdef OMP
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:nAdded)
+#endif
+  for (p = 0 ; p < EXT_PARTS ; ++p)
+    { char partName[strlen(stem)+8] ;
+      sprintf (partName, "%s.%d", stem, p) ;
+      nAdded += extCount (ms, partName, nWord, 0, min, memMax) ;
+    }
+  fprintf (outFile, "added %llu sequences total length %llu total hashes %llu, "
+	   "%llu distinct with count >= %d, new max %u\n", nSeq, totLen, totHash, nAdded, min, ms->max) ;
+  return true ;
+}
+
+static int depthOrder (const void *a, const void *b)
+{ U32 x = *(U32*)a, y = *(U32*)b ; return (x < y) ? -1 : (x > y) ; }
+
 void depthHistogram (Modset *ms, FILE *f)
 {
   Array h = arrayCreate (256, U32) ;
-  U32 i ;
+  Array big = arrayCreate (256, U32) ; /* depths >= U16MAX, sorted to count them */
+  U32 i, j ;
   for (i = 1 ; i <= ms->max ; ++i)
-    if (ms->depth[i] < arrayMax(h)) ++arr(h,ms->depth[i],U32) ; /* more efficient to check */
-    else ++array(h,ms->depth[i],U32) ;
+    { U32 d = msDepth (ms, i) ;
+      if (d < arrayMax(h)) ++arr(h,d,U32) ; /* more efficient to check */
+      else if (d < U16MAX) ++array(h,d,U32) ;
+      else array(big,arrayMax(big),U32) = d ;
+    }
   for (i = 0 ; i < arrayMax(h) ; ++i)
     if (arr(h,i,U32)) fprintf (f, "DP\t%u\t%u\n", i, arr(h,i,U32)) ;
-  arrayDestroy (h) ;
+  arraySort (big, depthOrder) ;
+  for (i = 0 ; i < arrayMax(big) ; i = j)
+    { j = i+1 ; while (j < arrayMax(big) && arr(big,j,U32) == arr(big,i,U32)) ++j ;
+      fprintf (f, "DP\t%u\t%u\n", arr(big,i,U32), j-i) ;
+    }
+  arrayDestroy (h) ; arrayDestroy (big) ;
 }
 
 void reportDepths (Modset *ms, Array ma, FILE *f)
 {
   U32 i, j, index ;
+  U64 *value = modsetValues (ms) ;
   for (i = 1 ; i <= ms->max ; ++i)
-    { fprintf (f, "MH\t%llx\t%d\t%u", ms->value[i], msCopy(ms,i), ms->depth[i]) ;
+    { if (ms->valueHi) fprintf (f, "MH\t%llx%016llx", ms->valueHi[i], value[i]) ;
+      else fprintf (f, "MH\t%llx", value[i]) ;
+      fprintf (f, "\t%d\t%u", msCopy(ms,i), msDepth (ms, i)) ;
+      for (j = 0 ; j < ms->nSample ; ++j) fprintf (f, "\t%u", msSample(ms,i)[j]) ;
       for (j = 0 ; j < arrayMax(ma) ; ++j)
-	if ((index = modsetIndexFind (arr(ma,j,Modset*), ms->value[i], false)))
-	  fprintf (f, "\t%u", arr(ma,j,Modset*)->depth[index]) ;
+	if ((index = modsetIndexFindLong (arr(ma,j,Modset*), msValue (ms, value, i), false)))
+	  fprintf (f, "\t%u", msDepth (arr(ma,j,Modset*), index)) ;
 	else
 	  fprintf (f, "\t0") ;
       fputc ('\n', f) ;
     }
+  free (value) ;
+}
+
+/* Set operations merge kmer-sorted runs of the mod files, made once and cached beside them
+   as <mod file>.srt.  A file only counts as containing a kmer if its depth passes -sf.
+*/
+
+U32 setMin = 1, setMax = 0 ;	/* setMin <= depth < setMax, or setMax 0 for no limit */
+
+static int fileCount (int argc, char **argv) /* number of file names before the next command */
+{ int n = 0 ; while (n < argc && *argv[n] != '-') ++n ; return n ; }
+
+static Modset *setSelect (Modset *ms, char **files, int n, int nIn, int minIn) /* replaces ms */
+{
+  if (n < 1) die ("set operation needs mod files") ;
+  MsRun **r = new (n, MsRun*) ;
+  int i ;
+#ifdef OMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (i = 0 ; i < n ; ++i) r[i] = modsetRunOpen (files[i]) ;
+  if (isVerbose) { fprintf (outFile, "opened sorted runs of %d mod files\n", n) ; timeUpdate (outFile) ; }
+  Modset *msNew = modsetRunSelect (r, n, nIn, minIn, setMin, setMax) ;
+  if (!msNew) die ("mod files have incompatible hash parameters - unable to combine them") ;
+  for (i = 0 ; i < n ; ++i) modsetRunClose (r[i]) ;
+  free (r) ;
+  if (ms) modsetDestroy (ms) ;
+  modsetLoad (msNew, load) ;
+  modsetSummary (msNew, outFile) ;
+  return msNew ;
+}
+
+/* Jaccard index, shared kmers over the union, and containment, shared over the first, for all
+   pairs of mod files, from the same sorted runs.  They are written as tab-separated matrices
+   with the file names as labels.  Containment row i column j is the fraction of file i's kmers
+   that are in file j.
+*/
+
+static void matrixWrite (char *name, char **files, int n, U64 *shared, bool isJaccard)
+{
+  FILE *f = fopen (name, "w") ;
+  if (!f) die ("failed to open matrix file %s", name) ;
+  int i, j ;
+  fprintf (f, "mod_file") ;
+  for (j = 0 ; j < n ; ++j) fprintf (f, "\t%s", files[j]) ;
+  fputc ('\n', f) ;
+  for (i = 0 ; i < n ; ++i)
+    { fprintf (f, "%s", files[i]) ;
+      for (j = 0 ; j < n ; ++j)
+	{ U64 x = shared[i*n+j], y = isJaccard ? shared[i*n+i] + shared[j*n+j] - x : shared[i*n+i] ;
+	  fprintf (f, "\t%.6f", y ? x / (double) y : 0.0) ;
+	}
+      fputc ('\n', f) ;
+    }
+  fclose (f) ;
+}
+
+static void setDistances (char *prefix, char **files, int n)
+{
+  if (n < 1) die ("jaccard needs mod files") ;
+  MsRun **r = new (n, MsRun*) ;
+  int i ;
+#ifdef OMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (i = 0 ; i < n ; ++i) r[i] = modsetRunOpen (files[i]) ;
+  if (isVerbose) { fprintf (outFile, "opened sorted runs of %d mod files\n", n) ; timeUpdate (outFile) ; }
+  U64 *shared = new ((U64)n*n, U64) ;
+  if (!modsetRunShared (r, n, setMin, setMax, shared, numThreads))
+    die ("mod files have incompatible hash parameters - unable to compare them") ;
+  for (i = 0 ; i < n ; ++i) modsetRunClose (r[i]) ;
+  free (r) ;
+  char name[strlen(prefix)+8] ;
+  sprintf (name, "%s.jac", prefix) ; matrixWrite (name, files, n, shared, true) ;
+  sprintf (name, "%s.con", prefix) ; matrixWrite (name, files, n, shared, false) ;
+  fprintf (outFile, "wrote Jaccard and containment matrices for %d mod files to %s.jac and %s.con\n",
+	   n, prefix, prefix) ;
+  free (shared) ;
+}
+
+/* The sample depth matrix in binary: "MSSMPv1\0", then int nSample, U32 n, int nWord, then
+   the n kmers as n U64, followed by n more for the high words if nWord is 2, then n rows of
+   nSample U16 depths, all in the order of the entries of the Modset.
+*/
+
+static void writeSamples (Modset *ms, FILE *f)
+{
+  int nWord = ms->valueHi ? 2 : 1 ;
+  if (fwrite ("MSSMPv1",8,1,f) != 1 || fwrite (&ms->nSample,sizeof(int),1,f) != 1
+      || fwrite (&ms->max,sizeof(U32),1,f) != 1 || fwrite (&nWord,sizeof(int),1,f) != 1)
+    die ("failed to write sample matrix header") ;
+  U64 *value = modsetValues (ms) ;
+  if (fwrite (value+1,sizeof(U64),ms->max,f) != ms->max) die ("failed to write sample matrix kmers") ;
+  free (value) ;
+  if (ms->valueHi && fwrite (ms->valueHi+1,sizeof(U64),ms->max,f) != ms->max)
+    die ("failed to write sample matrix kmers") ;
+  U64 n = (U64)ms->max * ms->nSample ;
+  if (fwrite (msSample (ms, 1),sizeof(U16),n,f) != n) die ("failed to write sample matrix") ;
 }
 
 void usage (void)
 { fprintf (stderr, "Usage: modutils <commands>\n") ;
   fprintf (stderr, "Commands are executed in order - set parameters before using them!\n") ;
   fprintf (stderr, "  -v | --verbose : toggle verbose mode\n") ;
+  fprintf (stderr, "  -t | --threads <number of threads for parallel ops> [%d]\n", numThreads) ;
+  fprintf (stderr, "       with more than 1, -a and -x number entries in an order set by thread timing\n") ;
   fprintf (stderr, "  -o | --output <output filename> : '-' for stdout\n") ;
-  fprintf (stderr, "  -c | --modcreate table_bits{28} kmer{19} mod{31} seed{17}: can truncate parameters\n") ;
+  fprintf (stderr, "  -l | --load <fraction> : fraction of index slots filled before the table doubles, set before -c [%.2f]\n", load) ;
+  fprintf (stderr, "       table bytes per entry, kmers included, at k <= 31 (k 19) 8.0 at 0.8, 7.1 at 0.9, 6.7 at 0.95\n") ;
+  fprintf (stderr, "       and at k > 31 13.3, 11.9, 11.2 plus 8 for the high words, max %.2f - depth and info add 2\n", MS_LOAD_MAX) ;
+  fprintf (stderr, "  -c | --modcreate table_bits{24} kmer{19} mod{31} seed{17} link{0}: can truncate parameters\n") ;
+  fprintf (stderr, "       link > 0 for seeds linking pairs of modimizers up to link bases apart\n") ;
+  fprintf (stderr, "       table_bits is the starting size - the table doubles as needed up to 34\n") ;
   fprintf (stderr, "  -w | --write <mod file> : custom binary\n") ;
-  fprintf (stderr, "  -r | --read <mod file>\n") ;
+  fprintf (stderr, "  -wm | --writemap <mod file> : uncompressed, for sharing between jobs via mmap\n") ;
+  fprintf (stderr, "  -r | --read <mod file> : either format\n") ;
   fprintf (stderr, "  -wt | --writetext <text file> : kmer,count,flags tab-separated\n") ;
   fprintf (stderr, "  -rt | --readtext <text file>  : hasher params in header line\n") ;
-  fprintf (stderr, "  -a | --add <read file> : add kmers from read file\n") ;
+  fprintf (stderr, "  -b | --bloom <bits> : -a and -x only add kmers seen twice, via a 2^bits bit filter; 0 for off\n") ;
+  fprintf (stderr, "       8 bits per distinct kmer gives ~4%% false positives - e.g. 33 (1GB) for 1G kmers\n") ;
+  fprintf (stderr, "  -a | --add <read file> : add kmers from read file, in parallel if -t > 1\n") ;
   fprintf (stderr, "  -x | --add10x <10x read file> : add kmers from 10x read file\n") ;
+  fprintf (stderr, "  -S | --sample <i> : -a, -x and -ae also count into depth column i of 0..n-1, -1 for none [%d]\n", sample) ;
+  fprintf (stderr, "       so one mod set holds the depths of many samples - written by -w, -wm, -d and -ws\n") ;
+  fprintf (stderr, "  -sh | --shard <i/n> : -a, -x and -ae only count kmers in shard i of 0..n-1 [%d/%d]\n", shard, nShard) ;
+  fprintf (stderr, "       run n jobs for shards 0/n to n-1/n on the same reads then combine with -mc\n") ;
+  fprintf (stderr, "  -ae | --addext <read file> <min> : add kmers seen >= min times, counting via files in -T\n") ;
+  fprintf (stderr, "       for read sets with more distinct kmers than fit in memory, e.g. min 2 drops errors\n") ;
+  fprintf (stderr, "  -T | --tmpdir <dir> : for -ae temporary files, best on local disk [%s]\n", tmpDir) ;
+  fprintf (stderr, "  -M | --maxmem <GB> : memory for sorting in -ae, on top of the mod set itself [%.0f]\n", maxMem) ;
   fprintf (stderr, "  -m | --merge <mod file> : add kmers from read file; writes depths\n") ;
+  fprintf (stderr, "  -mm | --mergemany <mod file>* : merge many mod files at once, in parallel if -t > 1\n") ;
+  fprintf (stderr, "  -mc | --mergeconcat <mod file> : fast merge of a mod file with no kmers in common, e.g. another shard\n") ;
+  fprintf (stderr, "  -su | --setunion <mod file>* : replace the mod set by the kmers in any of the files\n") ;
+  fprintf (stderr, "  -si | --setintersect <mod file>* : by the kmers in all of the files\n") ;
+  fprintf (stderr, "  -sd | --setdiff <mod file> <mod file>* : by the kmers in the first file and none of the rest\n") ;
+  fprintf (stderr, "  -sa | --setatleast <n> <mod file>* : by the kmers in at least n of the files\n") ;
+  fprintf (stderr, "       depths are summed over the files containing the kmer, as for -m\n") ;
+  fprintf (stderr, "  -sf | --setfilter <min> <max> : files only contain kmers with min <= depth < max, 0 for no max [%u %u]\n", setMin, setMax) ;
+  fprintf (stderr, "  -J | --jaccard <prefix> <mod file>* : write matrices <prefix>.jac of Jaccard index and\n") ;
+  fprintf (stderr, "       <prefix>.con of containment, the fraction of the row file's kmers in the column's, using -sf\n") ;
+  fprintf (stderr, "       the first set operation or -J on a file caches it sorted by kmer in <mod file>.srt\n") ;
   fprintf (stderr, "  -p | --prune <min> <max> : remove mod entries < min or >= max\n") ;
+  fprintf (stderr, "  -C | --coarsen <j> : keep only mods for window w << j, e.g. 1 for 2w\n") ;
   fprintf (stderr, "  -s | --setcopy <copy1min> <copy2min> <copyMmin> : reset mod copy\n") ;
   fprintf (stderr, "  -sM | --setcopyM <copyMmin> : set copyM if depth > copyMmin\n") ;
   fprintf (stderr, "  -H | --hist <outfile> : print depth histogram\n") ;
-  fprintf (stderr, "  -d | --depth <outfile> <mod file>* : print depth per mod [also in other files]\n") ;
+  fprintf (stderr, "  -d | --depth <outfile> <mod file>* : print depth per mod [per sample] [also in other files]\n") ;
+  fprintf (stderr, "  -ws | --writesamples <file> : binary kmers and matrix of U16 depth per sample - see modutils.c\n") ;
   fprintf (stderr, "  -P | --refpaint <ref seqfile> : print depth per mod along a reference sequence\n") ;
-  fprintf (stderr, "command -c or -r must come before other commands from -w onwards\n") ;
+  fprintf (stderr, "command -c, -r or a set operation must come before other commands from -w onwards\n") ;
   fprintf (stderr, "read files can be fasta or fastq, gzipped or not\n") ;
   fprintf (stderr, "example usage\n") ;
   fprintf (stderr, "  modutils -c 30 19 31 17 -a XR1.fa.gz -a XR2.fa.gz -w X.mod\n") ;
   fprintf (stderr, "  modutils -c 30 19 31 17 -a YR1.fa.gz -a YR2.fa.gz -w Y.mod\n") ;
-  fprintf (stderr, "  modutils -r X.mod -m Y.mod -w XY1.mod -H XY.his\n") ;
+  fprintf (stderr, "  modutils -r X.mod -m Y.mod -w XY1.mod -H XY.his   [or -mm Y.mod Z.mod ... for many]\n") ;
   fprintf (stderr, "then look at histogram XY.his and decide on thresholds, then\n") ;
   fprintf (stderr, "  modutils -r XY1.mod -p 5 200 -s 10 50 100 -w XY2.mod\n") ;
   fprintf (stderr, "  modutils -r XY2.mod -d XY.depths X.mod Y.mod\n") ;
   fprintf (stderr, "XY.depths will have columns: hash, depth_in_XY2, depth_inX, depth_in_Y\n") ;
+  fprintf (stderr, "sketches at windows 31, 62 and 124 from a single pass over the reads:\n") ;
+  fprintf (stderr, "  modutils -c 30 19 31 17 -a X.fa.gz -w X31.mod -C 1 -w X62.mod -C 1 -w X124.mod\n") ;
+  fprintf (stderr, "count a trio into one mod set, then write the depths of each kmer in each sample:\n") ;
+  fprintf (stderr, "  modutils -c 30 -S 0 -a C.fa.gz -S 1 -a M.fa.gz -S 2 -a F.fa.gz -w CMF.mod -d CMF.depths\n") ;
+  fprintf (stderr, "kmers in a child but in neither parent, ignoring those seen once as errors:\n") ;
+  fprintf (stderr, "  modutils -sf 2 0 -sd C.mod M.mod F.mod -w C_only.mod\n") ;
+  fprintf (stderr, "count in 4 array jobs with i = 0..3, then combine:\n") ;
+  fprintf (stderr, "  modutils -c 30 19 31 17 -sh i/4 -a X.fa.gz -w Xi.mod\n") ;
+  fprintf (stderr, "  modutils -r X0.mod -mc X1.mod -mc X2.mod -mc X3.mod -w X.mod\n") ;
 }
 
 int main (int argc, char *argv[])
@@ -114,6 +592,9 @@ int main (int argc, char *argv[])
 
   outFile = stdout ;
   timeUpdate (stdout) ;		/* initialise timer */
+#ifdef OMP
+  omp_set_num_threads (numThreads) ; /* serial unless -t, so entry order is reproducible */
+#endif
 
   Modset *ms = 0 ;
   int i ;			/* generically useful variables */
@@ -128,6 +609,16 @@ int main (int argc, char *argv[])
     
 #define ARGMATCH(x,y,n)	((!strcmp (*argv, x) || (!strcmp (*argv,y))) && argc >= n && (argc -= n, argv += n))
     if (ARGMATCH("-v","--verbose",1)) isVerbose = !isVerbose ;
+    else if (ARGMATCH("-t","--threads",2))
+      {
+#ifdef OMP
+	numThreads = atoi(argv[-1]) ;
+	if (numThreads > omp_get_max_threads ()) numThreads = omp_get_max_threads () ;
+	omp_set_num_threads (numThreads) ;
+#else
+	fprintf (stderr, "  can't set thread number - not compiled with OMP\n") ;
+#endif
+      }
     else if (ARGMATCH("-o","--output",2))
       { if (!strcmp (argv[-1], "-"))
 	  outFile = stdout ;
@@ -136,8 +627,12 @@ int main (int argc, char *argv[])
 	    outFile = stdout ;
 	  }
       }
+    else if (ARGMATCH("-l","--load",2))
+      { load = atof (argv[-1]) ;
+	if (load <= 0 || load > MS_LOAD_MAX) die ("load %s must be > 0 and <= %.2f", argv[-1], MS_LOAD_MAX) ;
+      }
     else if (!ms && ARGMATCH("-c","--create",1))
-      { int B = 28, k = 19, w = 31, s = 17 ;
+      { int B = 24, k = 19, w = 31, s = 17, L = 0 ;
 	if (argc && **argv != '-')
 	  { if (!(B = atoi(*argv)) || B < 20 || B > 34) die ("bad modbuild B %s", *argv) ;
 	    if (--argc && **++argv != '-')
@@ -146,19 +641,22 @@ int main (int argc, char *argv[])
 		  { if (!(w = atoi(*argv)) || k < 1) die ("bad modbuild w %s", *argv) ;
 		    if (--argc && **++argv != '-')
 		      { if (!(s = atoi(*argv))) die ("bad modbuild w %s", *argv) ;
-			--argc ; ++argv ;
+			if (--argc && **++argv != '-')
+			  { if ((L = atoi(*argv)) < 0) die ("bad modbuild link %s", *argv) ;
+			    --argc ; ++argv ;
+			  }
 		      }
 		  }
 	      }
 	  }
 	Seqhash *sh = seqhashCreate (k, w, s) ;
+	sh->link = L ;
 	seqhashReport (sh, outFile) ;
 	ms = modsetCreate (sh, B, 0) ;
+	modsetLoad (ms, load) ;
       }
     else if (!ms && ARGMATCH("-r","--read",2))
-      { if (!(f = fzopen (argv[-1], "r"))) die ("failed to open mod file %s", argv[-1]) ;
-	ms = modsetRead (f) ;
-	fclose (f) ;
+      { ms = modsetOpen (argv[-1]) ;
 	modsetSummary (ms, outFile) ;
       }
     else if (ms && ARGMATCH("-w","--write",2))
@@ -166,24 +664,29 @@ int main (int argc, char *argv[])
 	modsetWrite (ms, f) ;
 	fclose (f) ;
       }
+    else if (ms && ARGMATCH("-wm","--writemap",2))
+      modsetWriteMap (ms, argv[-1]) ;
     else if (!ms && ARGMATCH("-rt","--readtext",2))
       { if (!(f = fopen (argv[-1], "r"))) die ("failed to open text file %s", argv[-1]) ;
-	int bits, size, k, w, seed ;
-	if (fscanf (f, "modset bits %d size %d k %d w %d seed %d\n",
+	int bits, size, k, w, seed, link ;
+	if (fscanf (f, "modset bits %d size %d k %d w %d seed %d",
 		    &bits, &size, &k, &w, &seed) != 5)
 	  die ("failed to read first line of text file %s\n", argv[-1]) ;
+	if (fscanf (f, " link %d", &link) != 1) link = 0 ;
 	Seqhash *sh = seqhashCreate (k, w, seed) ;
+	sh->link = link ;
 	ms = modsetCreate (sh, bits, size) ;
-	static char seq[33] ; int depth ; int info ;
+	static char seq[64] ; int depth ; int info ;
 	U64 *conv = new0 (256, U64) ; conv['c'] = conv['C'] = 1 ;
 	conv['g'] = conv['G'] = 2 ; conv['t'] = conv['T'] = 3 ;
 	int ii ;
 	for (i = 0 ; i < size-1 ; ++i)
 	  { if (fscanf (f, "%d\t%s\t%d\t%d\n", &ii, seq, &depth, &info) != 4)
 	      die ("bad line %d", 2+i) ;
-	    U64 x = 0 ; char *s = seq ; while (*s) x = (x << 2) | conv[*s++] ;
-	    U32 index = modsetIndexFind (ms, x, true) ; // true to add
-	    ms->value[index] = x ; ms->depth[index] = depth ; ms->info[index] = info ;
+	    U128 x = 0 ; char *s = seq ; while (*s) x = (x << 2) | conv[*s++] ;
+	    if (link) x = strtoull (seq, 0, 16) ; /* linked seed keys are written in hex */
+	    U32 index = modsetIndexFindLong (ms, x, true) ; // true to add
+	    msDepthSet (ms, index, depth) ; ms->info[index] = info ;
 	  }
 	fclose (f) ;
 	modsetSummary (ms, outFile) ;
@@ -191,30 +694,43 @@ int main (int argc, char *argv[])
     else if (ms && ARGMATCH("-wt","--writetext",2))
       { if (!(f = fopen (argv[-1], "w"))) die ("failed to open text file %s", argv[-1]) ;
 	Seqhash *sh = ms->hasher ;
-	fprintf (f, "modset bits %d size %d k %d w %d seed %d\n",
+	fprintf (f, "modset bits %d size %d k %d w %d seed %d",
 		 ms->tableBits, ms->max+1, sh->k, sh->w, sh->seed) ;
+	if (sh->link) fprintf (f, " link %d", sh->link) ;
+	fputc ('\n', f) ;
+	U64 *value = modsetValues (ms) ;
 	for (i = 1 ; i <= ms->max ; ++i)
-	  fprintf (f, "%d\t%s\t%d\t%d\n",
-		   i, seqhashString(sh,ms->value[i]), ms->depth[i], ms->info[i]) ;
+	  if (sh->link)
+	    fprintf (f, "%d\t%llx\t%u\t%d\n", i, value[i], msDepth (ms, i), ms->info[i]) ;
+	  else
+	    fprintf (f, "%d\t%s\t%u\t%d\n",
+		     i, seqhashString(sh,msValue(ms,value,i)), msDepth (ms, i), ms->info[i]) ;
+	free (value) ;
 	fclose (f) ;
       }
     else if (ms && ARGMATCH("-p","--prune",3))
       { modsetDepthPrune (ms, atoi(argv[-2]), atoi(argv[-1])) ;
 	modsetSummary (ms, outFile) ;
       }
+    else if (ms && ARGMATCH("-C","--coarsen",2))
+      { Modset *msj = modsetCoarsen (ms, atoi(argv[-1])) ;
+	modsetDestroy (ms) ;
+	ms = msj ;
+	modsetSummary (ms, outFile) ;
+      }
     else if (ms && ARGMATCH("-s","--setcopy",4))
       { int copy1min = atoi(argv[-3]), copy2min = atoi(argv[-2]), copyMmin = atoi(argv[-1]) ;
 	U32 u ;
 	for (u = 1 ; u <= ms->max ; ++u)
-	  if (ms->depth[u] < copy1min) msSetCopy0(ms,u) ;
-	  else if (ms->depth[u] < copy2min) msSetCopy1(ms,u) ;
-	  else if (ms->depth[u] < copyMmin) msSetCopy2(ms,u) ;
+	  if (msDepth (ms, u) < copy1min) msSetCopy0(ms,u) ;
+	  else if (msDepth (ms, u) < copy2min) msSetCopy1(ms,u) ;
+	  else if (msDepth (ms, u) < copyMmin) msSetCopy2(ms,u) ;
 	  else msSetCopyM(ms,u) ;
 	modsetSummary (ms, outFile) ;
       }
     else if (ms && ARGMATCH("-sM","--setcopyM",2))
       { int copyMmin = atoi(argv[-1]) ;
-	U32 u ; for (u = 1 ; u <= ms->max ; ++u) if (ms->depth[u] >= copyMmin) msSetCopyM(ms,u) ;
+	U32 u ; for (u = 1 ; u <= ms->max ; ++u) if (msDepth (ms, u) >= copyMmin) msSetCopyM(ms,u) ;
 	modsetSummary (ms, outFile) ;
       }
     else if (ms && ARGMATCH("-a","--add",2))
@@ -227,16 +743,91 @@ int main (int argc, char *argv[])
 	  die ("failed to open sequence file %s", argv[-1]) ;
 	modsetSummary (ms, outFile) ;
       }
+    else if (ms && ARGMATCH("-ae","--addext",3))
+      { if (!addSequenceFileExternal (ms, argv[-2], atoi(argv[-1])))
+	  die ("failed to open sequence file %s", argv[-2]) ;
+	modsetSummary (ms, outFile) ;
+      }
+    else if (ARGMATCH("-T","--tmpdir",2))
+      tmpDir = argv[-1] ;
+    else if (ARGMATCH("-M","--maxmem",2))
+      { if ((maxMem = atof (argv[-1])) <= 0) die ("bad maxmem %s", argv[-1]) ; }
     else if (ms && ARGMATCH ("-m","--merge",2))
-      { if (!(f = fopen (argv[-1], "r"))) die ("failed to open mod file %s", argv[-1]) ;
-	Modset *ms2 = modsetRead (f) ;
+      { Modset *ms2 = modsetOpen (argv[-1]) ;
 	modsetSummary (ms2, outFile) ;
-	fclose (f) ;
 	if (!modsetMerge (ms, ms2))
 	  fprintf (stderr, "modset %s incompatible with current - unable to merge\n", argv[-1]) ;
 	modsetDestroy (ms2) ;
 	modsetSummary (ms, outFile) ;
       }
+    else if (ms && ARGMATCH ("-mm","--mergemany",1))
+      { int n = 0 ;
+	while (n < argc && *argv[n] != '-') ++n ;
+	Modset **ms2 = new (n, Modset*) ;
+#ifdef OMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+	for (i = 0 ; i < n ; ++i) ms2[i] = modsetOpen (argv[i]) ;
+	if (!modsetMergeMany (ms, ms2, n, numThreads))
+	  fprintf (stderr, "some of the %d modsets are incompatible with current - unable to merge\n", n) ;
+	for (i = 0 ; i < n ; ++i) modsetDestroy (ms2[i]) ;
+	free (ms2) ;
+	argc -= n ; argv += n ;
+	modsetSummary (ms, outFile) ;
+      }
+    else if (ms && ARGMATCH ("-mc","--mergeconcat",2))
+      { Modset *ms2 = modsetOpen (argv[-1]) ;
+	modsetSummary (ms2, outFile) ;
+	if (!modsetConcat (ms, ms2))
+	  fprintf (stderr, "modset %s incompatible with current - unable to merge\n", argv[-1]) ;
+	modsetDestroy (ms2) ;
+	modsetSummary (ms, outFile) ;
+      }
+    else if (ARGMATCH("-su","--setunion",1))
+      { int n = fileCount (argc, argv) ;
+	ms = setSelect (ms, argv, n, n, 1) ;
+	argc -= n ; argv += n ;
+      }
+    else if (ARGMATCH("-si","--setintersect",1))
+      { int n = fileCount (argc, argv) ;
+	ms = setSelect (ms, argv, n, n, n) ;
+	argc -= n ; argv += n ;
+      }
+    else if (ARGMATCH("-sd","--setdiff",2))
+      { int n = fileCount (argc, argv) ;
+	ms = setSelect (ms, argv-1, n+1, 1, 1) ;
+	argc -= n ; argv += n ;
+      }
+    else if (ARGMATCH("-sa","--setatleast",2))
+      { int m = atoi (argv[-1]), n = fileCount (argc, argv) ;
+	if (m < 1 || m > n) die ("bad setatleast %s for %d files", argv[-1], n) ;
+	ms = setSelect (ms, argv, n, n, m) ;
+	argc -= n ; argv += n ;
+      }
+    else if (ARGMATCH("-J","--jaccard",2))
+      { int n = fileCount (argc, argv) ;
+	setDistances (argv[-1], argv, n) ;
+	argc -= n ; argv += n ;
+      }
+    else if (ARGMATCH("-sf","--setfilter",3))
+      { setMin = atoi (argv[-2]) ; setMax = atoi (argv[-1]) ; }
+    else if (ARGMATCH("-b","--bloom",2))
+      { int bits = atoi (argv[-1]) ;
+	if (bloom) { bloomDestroy (bloom) ; bloom = 0 ; }
+	if (bits) bloom = bloomCreate (bits, 3) ;
+      }
+    else if (ms && ARGMATCH("-S","--sample",2))
+      { if ((sample = atoi (argv[-1])) >= 0) modsetSamples (ms, sample+1) ; }
+    else if (ms && ARGMATCH("-ws","--writesamples",2))
+      { if (!ms->nSample) die ("no samples to write - count with -S") ;
+	if (!(f = fopen (argv[-1], "w"))) die ("failed to open sample matrix file %s", argv[-1]) ;
+	writeSamples (ms, f) ;
+	fclose (f) ;
+      }
+    else if (ARGMATCH("-sh","--shard",2))
+      { if (sscanf (argv[-1], "%d/%d", &shard, &nShard) != 2 || nShard < 1 || shard < 0 || shard >= nShard)
+	  die ("bad shard %s - should be i/n with 0 <= i < n", argv[-1]) ;
+      }
     else if (ms && ARGMATCH ("-H","--hist",2))
       { if (!(f = fopen (argv[-1], "w"))) die ("failed to open histogram file %s", argv[-1]) ;
        depthHistogram (ms, f) ;
@@ -247,10 +838,8 @@ int main (int argc, char *argv[])
 	if (!(fd = fopen (argv[-1], "w"))) die ("failed to open depths file %s", argv[-1]) ;
 	Array ma = arrayCreate (32, Modset*) ;
 	while (argc && **argv != '-')
-	  { if (!(f = fopen (*argv, "r"))) die ("failed to open mod file %s", *argv) ;
-	    array(ma,arrayMax(ma),Modset*) = modsetRead (f) ;
+	  { array(ma,arrayMax(ma),Modset*) = modsetOpen (*argv) ;
 	    modsetSummary (arr(ma,arrayMax(ma)-1,Modset*), outFile) ;
-	    fclose (f) ;
 	    --argc ; ++argv ;
 	  }
 	reportDepths (ms, ma, fd) ;
@@ -260,15 +849,16 @@ int main (int argc, char *argv[])
     else if (ms && ARGMATCH ("-P","--refpaint",2))
       { SeqIO *si = seqIOopenRead (argv[-1], dna2indexConv, false) ; /* false for no qualities */
 	if (!si) die ("failed to open ref seq file %s", argv[-1]) ;
+	SeqhashBatch *sb = seqhashBatchCreate (1 << 20) ;
 	while (seqIOread (si))
 	  { printf ("painting %s length %d\n", sqioId(si), (int) si->seqLen) ;
-	    SeqhashRCiterator *mi = modRCiterator (ms->hasher, sqioSeq(si), si->seqLen) ;
-	    U64 kmer ; int pos ; U32 index ;
-	    while (modRCnext (mi, &kmer, &pos, 0))
-	      if ((index = modsetIndexFind (ms, kmer, false))) // false for do not add
-		printf ("  %d\t%d\n", pos, ms->depth[index]) ;
-	    seqhashRCiteratorDestroy (mi) ;
+	    int j, n = modRCbatchThreads (ms->hasher, sqioSeq(si), si->seqLen, sb, numThreads) ;
+	    modsetIndexFindBatch (ms, sb, false) ; // false for do not add
+	    for (j = 0 ; j < n ; ++j)
+	      if (sb->index[j])
+		printf ("  %d\t%u\n", sb->pos[j], msDepth (ms, sb->index[j])) ;
 	  }
+	seqhashBatchDestroy (sb) ;
 	seqIOclose (si) ;
       }
     else die ("unknown command %s - run without arguments for usage", *argv) ;
@@ -13,47 +13,88 @@
  */
 
 #include "seqhash.h"
+#include <stddef.h>		/* offsetof() */
 
 static inline U64 rotateLeft (U64 x) { return (x << 2) | (x >> 62) ; }
 static inline U64 rotateRight (U64 x) { return (x << 62) | (x >> 2) ; }
 
+/* Division is slow, so test divisibility by multiplying.  Write w = d << t with d odd.
+   Multiplication by dInv = 1/d mod 2^64 permutes the U64s, taking the multiples of d onto
+   0..U64MAX/d, and then rotating right by t also requires the low t bits to be 0.
+   So x % w == 0 iff rotateRight(x*dInv, t) <= U64MAX/w.  See seqhashIsMod() in seqhash.h.
+*/
+
+static inline void modDivConstants (U64 w, U64 *dInv, int *t, U64 *limit)
+{
+  int i ;
+  *limit = U64MAX / w ;
+  for (*t = 0 ; !(w & 1) ; w >>= 1) ++*t ;
+  *dInv = w ;			/* Newton iteration: each step doubles the correct low bits */
+  for (i = 0 ; i < 5 ; ++i) *dInv *= 2 - w * *dInv ;
+}
+
+static void seqhashDerive (Seqhash *sh) ; /* sets the fields not written to file - see below */
+
 Seqhash *seqhashCreate (int k, int w, int seed)
 {
   assert (sizeof (U64) == 8) ;
   Seqhash *sh = new0 (1, Seqhash) ;
-  sh->k = k ; if (k < 1 || k >= 32) die ("seqhash k %d must be between 1 and 32\n", k) ;
+  sh->k = k ; if (k < 1 || k >= 64) die ("seqhash k %d must be between 1 and 63\n", k) ;
   sh->w = w ; if (w < 1) die ("seqhash w %d must be positive\n", w) ;
   sh->seed = seed ;
-  sh->mask = ((U64)1 << (2*k)) - 1 ;
   int i ;
   
   srandom (seed) ;
   sh->factor1 = (random() << 32) | random() | 0x01 ;
-  sh->shift1 = 64 - 2*k ;
   sh->factor2 = (random() << 32) | random() | 0x01 ;
-  sh->shift2 = 2*k ;
-  for (i = 0 ; i < 4 ; ++i) { sh->patternRC[i] = (3-i) ; sh->patternRC[i] <<= 2*(k-1) ; }
+  if (!seqhashIsLong (sh))	/* long kmers use factor1 and factor2 together - see seqhashLong() */
+    { sh->mask = ((U64)1 << (2*k)) - 1 ;
+      sh->shift1 = 64 - 2*k ;
+      sh->shift2 = 2*k ;
+      for (i = 0 ; i < 4 ; ++i) { sh->patternRC[i] = (3-i) ; sh->patternRC[i] <<= 2*(k-1) ; }
+    }
+  seqhashDerive (sh) ;
   return sh ;
 }
 
+Seqhash *seqhashCoarsen (Seqhash *sh, int j)
+{
+  if (j < 0 || ((U64)sh->w << j) >> j != sh->w || ((U64)sh->w << j) > INT_MAX)
+    die ("can't coarsen seqhash w %d by level %d", sh->w, j) ;
+  Seqhash *shj = new (1, Seqhash) ;
+  *shj = *sh ;
+  shj->w = sh->w << j ;
+  seqhashDerive (shj) ;
+  return shj ;
+}
+
 #include <stdio.h>
 
+#define SEQHASH_FILE_SIZE offsetof(Seqhash,modInv) /* the derived fields are not written */
+#define SEQHASH_FILE_SIZE_V2 offsetof(Seqhash,link) /* v2 had no link */
+
 void seqhashWrite (Seqhash *sh, FILE *f)
-{ if (fwrite ("SQHSHv2",8,1,f) != 1) die ("failed to write seqhash header") ;
-  if (fwrite (sh,sizeof(Seqhash),1,f) != 1) die ("failed to write seqhash") ;
+{ if (fwrite ("SQHSHv3",8,1,f) != 1) die ("failed to write seqhash header") ;
+  if (fwrite (sh,SEQHASH_FILE_SIZE,1,f) != 1) die ("failed to write seqhash") ;
 }
 
 Seqhash *seqhashRead (FILE *f)
-{ Seqhash *sh = new (1, Seqhash) ;
+{ Seqhash *sh = new0 (1, Seqhash) ;
   char name[8] ;
   if (fread (name,8,1,f) != 1) die ("failed to read seqhash header") ;
-  if (strcmp (name, "SQHSHv2")) die ("seqhash read mismatch") ;
-  if (fread (sh,sizeof(Seqhash),1,f) != 1) die ("failed to read seqhash") ;
+  if (!strcmp (name, "SQHSHv2"))
+    { if (fread (sh,SEQHASH_FILE_SIZE_V2,1,f) != 1) die ("failed to read seqhash") ; }
+  else if (strcmp (name, "SQHSHv3")) die ("seqhash read mismatch") ;
+  else if (fread (sh,SEQHASH_FILE_SIZE,1,f) != 1) die ("failed to read seqhash") ;
+  seqhashDerive (sh) ;
   return sh ;
 }
 
 void seqhashReport (Seqhash *sh, FILE *f)
-{ fprintf (f, "SH k %d  w/m %d  s %d\n", sh->k, sh->w, sh->seed) ; }
+{ fprintf (f, "SH k %d  w/m %d  s %d", sh->k, sh->w, sh->seed) ;
+  if (sh->link) fprintf (f, "  link %d", sh->link) ;
+  fputc ('\n', f) ;
+}
 
 /************** basic hash functions *************/
 
@@ -70,8 +111,10 @@ static inline U64 hashRC (SeqhashRCiterator *si, bool *isForward)
 static inline U64 advanceHashRC (SeqhashRCiterator *si, bool *isForward)
 { Seqhash *sh = si->sh ;
   if (si->s < si->sEnd)
-    { si->h = ((si->h << 2) & sh->mask) | *(si->s) ;
-      si->hRC = (si->hRC >> 2) | sh->patternRC[*(si->s)] ;
+    { int c = *si->s ;
+      if ((unsigned) c > 3) { si->sOK = si->s + sh->k + 1 ; c &= 3 ; } /* ambiguous - see modRCisHit() */
+      si->h = ((si->h << 2) & sh->mask) | c ;
+      si->hRC = (si->hRC >> 2) | sh->patternRC[c] ;
       return hashRC (si, isForward) ;
     }
   else
@@ -80,29 +123,88 @@ static inline U64 advanceHashRC (SeqhashRCiterator *si, bool *isForward)
 
 /************ iterator to run across a sequence ***********/
 
+/* The minimizer reported after one at position p is the minimum over the window p+1..p+w,
+   with ties going to the lower p % w.  Rather than rescan the window each time we split the
+   sequence into blocks of w kmers and keep two consecutive blocks in hashBuf, the first at
+   0..w-1 and the second at w..2w-1, alternating.  For each block we keep prefix minima as
+   kmers are added and suffix minima once it is complete.  Any window then consists of a
+   suffix of one block followed by a prefix of the next, so its minimum is the lesser of
+   the two, found in constant time.  Loading costs two comparisons per kmer, without the
+   data dependent branches of a deque, so it is O(1) per base whatever w is.
+*/
+
+static inline void minimizerLoad (SeqhashRCiterator *si, int iEnd) /* load kmers up to iEnd */
+{
+  Seqhash *sh = si->sh ;
+  int w = sh->w, x = si->xEnd ;
+  U64 *h = si->hashBuf, hF = si->h, hR = si->hRC ; /* local copies so they stay in registers */
+  bool *fBuf = si->fBuf ;
+  char *s = si->s ;
+  int *pre = si->preMin ;
+  int xMin = pre[x] ; U64 hMin = h[xMin] ; /* running prefix min */
+  for ( ; si->iEnd < iEnd ; ++si->iEnd, ++s)
+    { if (++x == 2*w) x = 0 ;
+      U64 hx = U64MAX ; bool isF = false ;
+      if (s < si->sEnd)		/* as advanceHashRC() but without branching on orientation */
+	{ hF = ((hF << 2) & sh->mask) | (*s & 3) ; /* ambiguous bases are not skipped here */
+	  hR = (hR >> 2) | sh->patternRC[*s & 3] ;
+	  U64 hashF = seqhash (sh, hF), hashR = seqhash (sh, hR) ;
+	  isF = hashF < hashR ; hx = isF ? hashF : hashR ;
+	}
+      h[x] = hx ; fBuf[x] = isF ;
+      if (x == 0 || x == w || hx < hMin) { hMin = hx ; xMin = x ; }
+      pre[x] = xMin ;
+      if (x == w-1 || x == 2*w-1) /* completed a block, so fill its suffix minima */
+	{ int *suf = si->sufMin, y ;
+	  U64 hSuf = hx ; int xSuf = x ;
+	  for (y = x ; y > x-w ; --y)
+	    { if (h[y] <= hSuf) { hSuf = h[y] ; xSuf = y ; }
+	      suf[y] = xSuf ;
+	    }
+	}
+    }
+  si->h = hF ; si->hRC = hR ; si->s = s ;
+  si->xEnd = x ;
+}
+
+static inline int minimizerFind (SeqhashRCiterator *si, int a, int *pos) /* window a..a+w-1 */
+{
+  int w = si->sh->w, j = a % w ;
+  int xa = ((a / w) & 1) ? w : 0 ; /* start in hashBuf of block containing a */
+  int x = si->sufMin[xa + j] ;
+  *pos = a + x - (xa + j) ;
+  if (j)			/* window continues into the start of the next block */
+    { int xb = w - xa, y = si->preMin[xb + j - 1] ;
+      if (si->hashBuf[y] <= si->hashBuf[x]) { x = y ; *pos = a - j + w + y - xb ; }
+    }
+  return x ;
+}
+
 SeqhashRCiterator *minimizerRCiterator (Seqhash *sh, char *s, int len)
 {
+  if (seqhashIsLong (sh)) die ("seqhash iterators need k <= 31, not %d - use modRCbatch()", sh->k) ;
   assert (s && len >= 0) ;
   SeqhashRCiterator *si = (SeqhashRCiterator*) mycalloc (sizeof(SeqhashRCiterator), 1) ;
   si->sh = sh ;
   si->s = s ; si->sEnd = s + len ;
-  si->hashBuf = new0 (sh->w, U64) ;
-  si->fBuf = new0 (sh->w, bool) ;
+  si->hashBuf = new0 (2*sh->w, U64) ;
+  si->fBuf = new0 (2*sh->w, bool) ;
+  si->preMin = new0 (2*sh->w, int) ;
+  si->sufMin = new0 (2*sh->w, int) ;
   if (len < sh->k) { si->isDone = true ; return si ; } /* edge case */
+  si->nKmer = len - sh->k + 1 ;
 
   int i ;			/* preinitialise the hashes for the first kmer */
   for (i = 0 ; i < sh->k ; ++i, ++si->s)
-    { si->h = (si->h << 2) | *si->s ;
-      si->hRC = (si->hRC >> 2) | sh->patternRC[*(si->s)] ;
+    { si->h = (si->h << 2) | (*si->s & 3) ;
+      si->hRC = (si->hRC >> 2) | sh->patternRC[*si->s & 3] ;
     }
   
-  /* store first w hashes in hashBuf and set ->iMin */
-  U64 min = hashRC (si, si->fBuf) ;
-  si->iMin = 0 ;
-  for (i = 1 ; i < sh->w ; ++i, ++si->s)
-    { si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
-      if (si->hashBuf[i] < min) { min = si->hashBuf[i] ; si->iMin = i ; }
-    }
+  /* load the first block - beyond the end of the sequence hashes are U64MAX */
+  si->hashBuf[0] = hashRC (si, si->fBuf) ; /* kmer 0 goes in at iEnd = xEnd = 0 */
+  si->preMin[0] = si->sufMin[0] = 0 ;
+  minimizerLoad (si, sh->w - 1) ;
+  si->iMin = minimizerFind (si, 0, &si->pMin) ;
 
   return si ;
 }
@@ -111,66 +213,55 @@ bool minimizerRCnext (SeqhashRCiterator *si, U64 *u, int *pos, bool *isF) /* ret
 {
   if (si->isDone) return false ; /* we are done */
 
-#ifdef DEBUG
-  printf ("base %d, iStart %d, iMin %d\n", si->base, si->iStart, si->iMin) ;
-  int j ; for (j = 0 ; j < si->sh->w ; ++j) printf ("  %x", si->hashBuf[j]) ;
-  printf ("\n") ;
-#endif
-
+  int p = si->pMin ;
   assert (u) ;
   *u = si->hashBuf[si->iMin] ;
-  if (pos) { *pos = si->base + si->iMin ; if (si->iMin < si->iStart) *pos += si->sh->w ; }
+  if (pos) *pos = p ;
   if (isF) *isF = si->fBuf[si->iMin] ;
-  if (si->s >= si->sEnd) { si->isDone = true ; return true ; }
+  if (si->iEnd >= si->nKmer-1) { si->isDone = true ; return true ; }
 
-  int i ;	    		/* next update hashBuf splitting into two cases */
-  U64 min = *u ;    /* save this here for end case - see below */
-  if (si->iMin >= si->iStart)
-    for (i = si->iStart ; i <= si->iMin ; ++i, ++si->s)
-      si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
-  else
-    { for (i = si->iStart ; i < si->sh->w ; ++i, ++si->s)
-	si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
-      si->base += si->sh->w ;
-      for (i = 0 ; i <= si->iMin ; ++i, ++si->s)
-	si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
-    }
-  si->iStart = si->iMin + 1 ;
-  if (si->iStart == si->sh->w) { si->iStart = 0 ; si->base += si->sh->w ; }
+  minimizerLoad (si, p + si->sh->w) ; /* next window is p+1..p+w */
+  si->iMin = minimizerFind (si, p+1, &si->pMin) ;
 
-  /* finally find new min to set up for next call */
-  if (si->hashBuf[si->iMin] != U64MAX) /* there was a full new window */
-    min = U64MAX ;
-  else				/* otherwise, keep the last min */
-    si->iMin = -1 ;
-  for (i = 0 ; i < si->sh->w ; ++i)
-    if (si->hashBuf[i] < min) { min = si->hashBuf[i] ; si->iMin = i ; }
-  if (si->iMin == -1)		/* our old min was not beaten - we are done */
+  /* if the window runs off the end of the sequence, only continue if we beat the last min */
+  if (si->iEnd >= si->nKmer && si->hashBuf[si->iMin] >= *u)
     si->isDone = true ;
-  
+
   return true ;
 }
 
+/* Base codes outside 0..3 are ambiguous, e.g. 4 for N and -2 for other IUPAC codes from
+   dna2indexConv, so they are tested unsigned, and no kmer containing one is reported.  The
+   kmer ending at si->s - 1 is clean iff si->s >= si->sOK.
+*/
+
+static inline bool modRCisHit (SeqhashRCiterator *si, U64 hash)
+{ return seqhashIsMod (si->sh, hash) && si->s >= si->sOK ; }
+
 SeqhashRCiterator *modRCiterator (Seqhash *sh, char *s, int len)
 {
+  if (seqhashIsLong (sh)) die ("seqhash iterators need k <= 31, not %d - use modRCbatch()", sh->k) ;
+  if (sh->link) die ("modRCiterator can't make linked seeds - use modRCbatch()") ;
   assert (s && len >= 0) ;
   SeqhashRCiterator *si = (SeqhashRCiterator*) mycalloc (sizeof(SeqhashRCiterator), 1) ;
   si->sh = sh ;
-  si->s = s ; si->sEnd = s + len ;
+  si->s = si->sOK = s ; si->sEnd = s + len ;
   si->hashBuf = new0 (sh->w, U64) ;
   si->fBuf = new0 (sh->w, bool) ;
   if (len < sh->k) { si->isDone = true ; return si ; } /* edge case */
 
   int i ;			/* preinitialise the hashes for the first kmer */
   for (i = 0 ; i < sh->k ; ++i, ++si->s)
-    { si->h = (si->h << 2) | *si->s ;
-      si->hRC = (si->hRC >> 2) | sh->patternRC[*(si->s)] ;
+    { int c = *si->s ;
+      if ((unsigned) c > 3) { si->sOK = si->s + sh->k + 1 ; c &= 3 ; }
+      si->h = (si->h << 2) | c ;
+      si->hRC = (si->hRC >> 2) | sh->patternRC[c] ;
     }
   
   U64 hash = hashRC(si, si->fBuf) ;
-  while ((hash % sh->w) && si->s < si->sEnd)
+  while (!modRCisHit (si, hash) && si->s < si->sEnd)
     { hash = advanceHashRC (si, si->fBuf) ; ++si->iMin ; ++si->s ; }
-  if (!(hash % sh->w)) *si->hashBuf = hash ;
+  if (modRCisHit (si, hash)) *si->hashBuf = hash ;
   else si->isDone = true ;
 
   return si ;
@@ -186,20 +277,417 @@ bool modRCnext (SeqhashRCiterator *si, U64 *kmer, int *pos, bool *isF)
   if (si->s >= si->sEnd) { si->isDone = true ; return true ; }
     
   U64 u = advanceHashRC (si, si->fBuf) ; ++si->iMin ; ++si->s ;
-  int w = si->sh->w ;
-  while ((u % w) && si->s < si->sEnd)
+  while (!modRCisHit (si, u) && si->s < si->sEnd)
     { u = advanceHashRC (si, si->fBuf) ; ++si->iMin ; ++si->s ; }
-  if (!(u % w)) *si->hashBuf = u ;
+  if (modRCisHit (si, u)) *si->hashBuf = u ;
   else si->isDone = true ;
 
   return true ;
 }
 
-char *seqString (U64 kmer, int len)
+/************ batch extraction into reusable arrays ***********/
+
+SeqhashBatch *seqhashBatchCreate (int size)
+{
+  SeqhashBatch *sb = new0 (1, SeqhashBatch) ;
+  if (size < 1) size = 1 ;
+  sb->size = size ;
+  sb->kmer = new (size, U64) ;
+  sb->pos = new (size, int) ;
+  sb->isF = new (size, bool) ;
+  sb->index = new (size, U32) ;
+  return sb ;
+}
+
+static void linkSpaceCreate (SeqhashBatch *sb)
+{
+  sb->linkHash = new (sb->size, U64) ; sb->linkId = new (sb->size, U64) ;
+  sb->linkPair = new (2*sb->size, U64) ;
+  sb->linkPos = new (sb->size, int) ; sb->linkFwd = new (sb->size, int) ;
+  sb->linkBwd = new (sb->size, int) ; sb->linkIsF = new (sb->size, bool) ;
+}
+
+static void seqhashBatchResize (SeqhashBatch *sb, int size)
+{
+  free (sb->kmer) ; free (sb->pos) ; free (sb->isF) ; free (sb->index) ; /* about to be refilled */
+  sb->size = size ;
+  sb->kmer = new (size, U64) ;
+  if (sb->kmerHi) { free (sb->kmerHi) ; sb->kmerHi = new0 (size, U64) ; }
+  sb->pos = new (size, int) ;
+  sb->isF = new (size, bool) ;
+  sb->index = new (size, U32) ;
+  if (sb->linkHash)		/* work space, so no need to copy */
+    { free (sb->linkHash) ; free (sb->linkId) ; free (sb->linkPair) ;
+      free (sb->linkPos) ; free (sb->linkFwd) ; free (sb->linkBwd) ; free (sb->linkIsF) ;
+      linkSpaceCreate (sb) ;
+    }
+}
+
+static inline void seqhashBatchReserve (Seqhash *sh, SeqhashBatch *sb, int len)
+{ int need = sh->link ? 2*len : len ; /* at most one modimizer per kmer, two seeds per modimizer */
+  if (need > sb->size) seqhashBatchResize (sb, need > 2*sb->size ? need : 2*sb->size) ;
+  if (sb->kmerHi && !seqhashIsLong (sh)) /* so a batch last used for k > 31 has no stale kmerHi */
+    { free (sb->kmerHi) ; sb->kmerHi = 0 ; }
+}
+
+/* The modimizer kernels below are written as always-inline bodies taking k and the
+   divisibility constants as arguments.  modKernelGeneric() passes the values from the
+   Seqhash, and MOD_KERNEL(K,W) instantiates a copy with K and W fixed at compile time, so
+   that the mask, shifts and divisibility constants fold into immediates.  seqhashDerive()
+   picks the specialised kernel if there is one for (k,w), else the generic one.  Each comes
+   in two versions, reading one char per base, or 2-bit codes packed 4 per byte (isPacked).
+*/
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+/* base i of s, for packed sequence offset by off bases, first base in the high bits */
+static ALWAYS_INLINE U64 seqBase (char *s, int off, int i, bool isPacked)
+{ if (isPacked) { i += off ; return (((U8*)s)[i >> 2] >> (6 - 2*(i & 0x3))) & 0x3 ; }
+  else return s[i] ;
+}
+
+/* serial scan of kmers starting at positions start..end-1, writing hits at kmer,pos,isF */
+
+static ALWAYS_INLINE int modScanBody (Seqhash *sh, char *s, int off, int start, int end,
+				      U64 *kmer, int *pos, bool *isF,
+				      int k, U64 dInv, int t, U64 limit, bool isPacked)
+{
+  int i, n = 0 ;
+  int shift = 64 - 2*k, rcShift = 2*k - 2 ; /* NB (c^3) << rcShift is patternRC[c] */
+  U64 h = 0, hRC = 0, mask = ((U64)1 << (2*k)) - 1, factor = sh->factor1 ;
+  int iOK = start ;		/* first kmer start not spanning an ambiguous base */
+  for (i = start ; i < start + k-1 ; ++i) /* preinitialise the hashes for the first kmer */
+    { U64 c = seqBase (s, off, i, isPacked) ;
+      if (c > 3) { iOK = i+1 ; c &= 3 ; }
+      h = (h << 2) | c ;
+      hRC = (hRC >> 2) | ((c ^ 3) << rcShift) ;
+    }
+  for (i = start ; i < end ; ++i)
+    { U64 c = seqBase (s, off, i+k-1, isPacked) ;
+      if (c > 3) { iOK = i+k ; c &= 3 ; } /* never taken, so free, if there are no Ns */
+      h = ((h << 2) & mask) | c ;
+      hRC = (hRC >> 2) | ((c ^ 3) << rcShift) ;
+      U64 hashF = (h * factor) >> shift, hashR = (hRC * factor) >> shift ;
+      bool f = (hashF < hashR) ;	/* written to compile to selects rather than branches */
+      U64 x = (f ? hashF : hashR) * dInv ;
+      if (((x >> t) | (x << ((64-t) & 63))) <= limit && i >= iOK)
+	{ kmer[n] = f ? h : hRC ; pos[n] = i ; isF[n] = f ; ++n ; }
+    }
+  return n ;
+}
+
+/* Multi-lane version, only for single sequences of at least SEQHASH_LANES*SEQHASH_LANE_MIN
+   kmers (contigs, chromosomes) - short reads go through the serial scan unchanged.
+   The kmer start positions are split into SEQHASH_LANES equal chunks that are advanced in
+   lockstep, one base per lane per step.  The lanes are independent so the shift/multiply
+   chains can overlap in the pipeline, and the lane loops are simple enough for the compiler
+   to vectorise where the target allows.  How much this gains depends on the target: the
+   serial loop only carries the shift/or from base to base, so out-of-order execution
+   already overlaps much of it.  Running one short read per lane instead was tried, and at
+   150bp was slower than the serial scan, the setup and tail per read outweighing the overlap.
+   Each lane writes its hits into its own region of the output starting at its chunk start
+   (there is at most one hit per position), then the regions are closed up so the result
+   is identical to the serial scan.
+*/
+
+#define SEQHASH_LANES 4
+#define SEQHASH_LANE_MIN 256	/* minimum kmers per lane - below this setup and tail dominate */
+
+static ALWAYS_INLINE int modLanesBody (Seqhash *sh, char *s, int off, int nKmer,
+				       U64 *kmer, int *pos, bool *isF,
+				       int k, U64 dInv, int t, U64 limit, bool isPacked)
+{
+  int i, j ;
+  int m = nKmer / SEQHASH_LANES ;
+  if (isPacked) m &= ~0x3 ;	/* so all lanes share the same position within their bytes */
+  int shift = 64 - 2*k, rcShift = 2*k - 2 ;
+  U64 mask = ((U64)1 << (2*k)) - 1, factor = sh->factor1 ;
+  U64 h[SEQHASH_LANES], hRC[SEQHASH_LANES], hash[SEQHASH_LANES] ;
+  int n[SEQHASH_LANES], iOK[SEQHASH_LANES] ; /* iOK as in modScanBody(), relative to lane start */
+
+  for (j = 0 ; j < SEQHASH_LANES ; ++j)
+    { n[j] = 0 ; h[j] = 0 ; hRC[j] = 0 ; iOK[j] = 0 ;
+      for (i = 0 ; i < k-1 ; ++i)
+	{ U64 c = seqBase (s, off, j*m + i, isPacked) ;
+	  if (c > 3) { iOK[j] = i+1 ; c &= 3 ; }
+	  h[j] = (h[j] << 2) | c ;
+	  hRC[j] = (hRC[j] >> 2) | ((c ^ 3) << rcShift) ;
+	}
+    }
+
+  for (i = 0 ; i < m ; ++i)
+    { int b = off + i + k-1, bShift = 6 - 2*(b & 0x3) ; /* only used if isPacked */
+      for (j = 0 ; j < SEQHASH_LANES ; ++j)
+	{ U64 c = isPacked ? (((U8*)s)[(b >> 2) + j*(m >> 2)] >> bShift) & 0x3 : s[j*m + i + k-1] ;
+	  if (c > 3) { iOK[j] = i+k ; c &= 3 ; }
+	  h[j] = ((h[j] << 2) & mask) | c ;
+	  hRC[j] = (hRC[j] >> 2) | ((c ^ 3) << rcShift) ;
+	}
+      for (j = 0 ; j < SEQHASH_LANES ; ++j)
+	{ U64 hashF = (h[j] * factor) >> shift, hashR = (hRC[j] * factor) >> shift ;
+	  U64 x = ((hashF < hashR) ? hashF : hashR) * dInv ;
+	  hash[j] = (x >> t) | (x << ((64-t) & 63)) ;
+	}
+      for (j = 0 ; j < SEQHASH_LANES ; ++j)
+	if (hash[j] <= limit && i >= iOK[j])
+	  { int x = j*m + n[j]++ ;
+	    bool f = (seqhash (sh, h[j]) < seqhash (sh, hRC[j])) ; /* rare, so recompute */
+	    kmer[x] = f ? h[j] : hRC[j] ; pos[x] = j*m + i ; isF[x] = f ;
+	  }
+    }
+
+  /* the last lane picks up any remainder serially */
+  j = SEQHASH_LANES-1 ;
+  if (SEQHASH_LANES*m < nKmer)
+    { int x = j*m + n[j] ;
+      n[j] += modScanBody (sh, s, off, SEQHASH_LANES*m, nKmer, kmer+x, pos+x, isF+x,
+			   k, dInv, t, limit, isPacked) ;
+    }
+
+  int nTot = n[0] ;		/* close up the lane regions */
+  for (j = 1 ; j < SEQHASH_LANES ; ++j)
+    { memmove (kmer+nTot, kmer+j*m, n[j]*sizeof(U64)) ;
+      memmove (pos+nTot, pos+j*m, n[j]*sizeof(int)) ;
+      memmove (isF+nTot, isF+j*m, n[j]*sizeof(bool)) ;
+      nTot += n[j] ;
+    }
+  return nTot ;
+}
+
+static ALWAYS_INLINE int modKernelBody (Seqhash *sh, char *s, int off, int nKmer,
+					U64 *kmer, int *pos, bool *isF,
+					int k, U64 dInv, int t, U64 limit, bool isPacked)
+{
+  if (nKmer >= SEQHASH_LANES*SEQHASH_LANE_MIN)
+    return modLanesBody (sh, s, off, nKmer, kmer, pos, isF, k, dInv, t, limit, isPacked) ;
+  else
+    return modScanBody (sh, s, off, 0, nKmer, kmer, pos, isF, k, dInv, t, limit, isPacked) ;
+}
+
+static int modKernelGeneric (Seqhash *sh, char *s, int nKmer, U64 *kmer, int *pos, bool *isF)
+{ return modKernelBody (sh, s, 0, nKmer, kmer, pos, isF,
+			sh->k, sh->modInv, sh->modShift, sh->modLimit, false) ;
+}
+
+static int modKernelPackedGeneric (Seqhash *sh, U8 *u, int off, int nKmer,
+				   U64 *kmer, int *pos, bool *isF)
+{ return modKernelBody (sh, (char*)u, off, nKmer, kmer, pos, isF,
+			sh->k, sh->modInv, sh->modShift, sh->modLimit, true) ;
+}
+
+#define MOD_KERNEL(K,W) \
+  static int modKernel_##K##_##W (Seqhash *sh, char *s, int nKmer, U64 *kmer, int *pos, bool *isF) \
+  { U64 dInv, limit ; int t ; modDivConstants (W, &dInv, &t, &limit) ; \
+    return modKernelBody (sh, s, 0, nKmer, kmer, pos, isF, K, dInv, t, limit, false) ; \
+  } \
+  static int modKernelPacked_##K##_##W (Seqhash *sh, U8 *u, int off, int nKmer, \
+					U64 *kmer, int *pos, bool *isF) \
+  { U64 dInv, limit ; int t ; modDivConstants (W, &dInv, &t, &limit) ; \
+    return modKernelBody (sh, (char*)u, off, nKmer, kmer, pos, isF, K, dInv, t, limit, true) ; \
+  }
+
+/* the parameter sets we use routinely - add more here as needed */
+MOD_KERNEL(19,31)  MOD_KERNEL(19,63)  MOD_KERNEL(19,127)
+MOD_KERNEL(21,31)  MOD_KERNEL(21,63)  MOD_KERNEL(21,127)
+MOD_KERNEL(31,31)  MOD_KERNEL(31,63)  MOD_KERNEL(31,127)
+
+#define MOD_KERNEL_ENTRY(K,W) { K, W, modKernel_##K##_##W, modKernelPacked_##K##_##W }
+
+static struct {
+  int k, w ;
+  int (*kernel) (Seqhash *sh, char *s, int nKmer, U64 *kmer, int *pos, bool *isF) ;
+  int (*kernelPacked) (Seqhash *sh, U8 *u, int off, int nKmer, U64 *kmer, int *pos, bool *isF) ;
+} modKernels[] = {
+  MOD_KERNEL_ENTRY(19,31), MOD_KERNEL_ENTRY(19,63), MOD_KERNEL_ENTRY(19,127),
+  MOD_KERNEL_ENTRY(21,31), MOD_KERNEL_ENTRY(21,63), MOD_KERNEL_ENTRY(21,127),
+  MOD_KERNEL_ENTRY(31,31), MOD_KERNEL_ENTRY(31,63), MOD_KERNEL_ENTRY(31,127),
+  { 0, 0, 0, 0 }
+} ;
+
+static void seqhashDerive (Seqhash *sh)
+{
+  int i ;
+  modDivConstants (sh->w, &sh->modInv, &sh->modShift, &sh->modLimit) ;
+  sh->modKernel = modKernelGeneric ;
+  sh->modKernelPacked = modKernelPackedGeneric ;
+  for (i = 0 ; modKernels[i].k ; ++i)
+    if (modKernels[i].k == sh->k && modKernels[i].w == sh->w)
+      { sh->modKernel = modKernels[i].kernel ;
+	sh->modKernelPacked = modKernels[i].kernelPacked ;
+      }
+}
+
+/* Kernel for 32 <= k <= 63, with the kmers in U128 and seqhashLong() as hash.  This is
+   only used when the Seqhash was created with k > 31, so the U64 kernels above are untouched.
+   There is no lane version: the 128-bit multiplies dominate and the compiler already
+   overlaps them across iterations.  Hits go to sb->kmer and sb->kmerHi.
+*/
+
+static ALWAYS_INLINE int modScanLongBody (Seqhash *sh, char *s, int off, int nKmer,
+					  SeqhashBatch *sb, bool isPacked)
+{
+  int i, n = 0, k = sh->k ;
+  int rcShift = 2*k - 2 ;
+  U128 h = 0, hRC = 0, mask = ((U128)1 << (2*k)) - 1 ;
+  U128 factor = ((U128)sh->factor2 << 64) | sh->factor1 ;
+  U64 dInv = sh->modInv, limit = sh->modLimit ; int t = sh->modShift ;
+  U64 *kmer = sb->kmer, *kmerHi = sb->kmerHi ; int *pos = sb->pos ; bool *isF = sb->isF ;
+  int iOK = 0 ;			/* as in modScanBody() */
+  for (i = 0 ; i < k-1 ; ++i)
+    { U128 c = seqBase (s, off, i, isPacked) ;
+      if (c > 3) { iOK = i+1 ; c &= 3 ; }
+      h = (h << 2) | c ;
+      hRC = (hRC >> 2) | ((c ^ 3) << rcShift) ;
+    }
+  for (i = 0 ; i < nKmer ; ++i)
+    { U128 c = seqBase (s, off, i+k-1, isPacked) ;
+      if (c > 3) { iOK = i+k ; c &= 3 ; }
+      h = ((h << 2) & mask) | c ;
+      hRC = (hRC >> 2) | ((c ^ 3) << rcShift) ;
+      U64 hashF = (h * factor) >> 64, hashR = (hRC * factor) >> 64 ;
+      bool f = (hashF < hashR) ;
+      U64 x = (f ? hashF : hashR) * dInv ;
+      if (((x >> t) | (x << ((64-t) & 63))) <= limit && i >= iOK)
+	{ U128 u = f ? h : hRC ;
+	  kmer[n] = (U64)u ; kmerHi[n] = (U64)(u >> 64) ; pos[n] = i ; isF[n] = f ; ++n ;
+	}
+    }
+  return n ;
+}
+
+static int modRCbatchLong (Seqhash *sh, char *s, int off, int len, SeqhashBatch *sb, bool isPacked)
+{
+  if (!sb->kmerHi) sb->kmerHi = new (sb->size, U64) ;
+  if (isPacked) return modScanLongBody (sh, s, off, len - sh->k + 1, sb, true) ;
+  else return modScanLongBody (sh, s, 0, len - sh->k + 1, sb, false) ;
+}
+
+/* Linked seeds, in the style of randstrobes.  A single modimizer in low complexity sequence
+   hits many places, but a pair of them, with the partner chosen by a function of the hashes
+   rather than a fixed offset, is much more specific while still tolerating indels between
+   them.  To get the same seeds from both strands we pair each modimizer with its best
+   partner downstream and its best upstream, with ties to the nearest, drop duplicates, and
+   make the key and orientation independent of the order of the pair.  Replaces the
+   modimizers in sb with the seeds, in order of their left member, returning the number.
+*/
+
+static int pairOrder (const void *a, const void *b)
+{ U64 x = *(U64*)a, y = *(U64*)b ; return (x < y) ? -1 : (x > y) ; }
+
+static int modLinkBatch (Seqhash *sh, SeqhashBatch *sb)
+{
+  int i, j, n = sb->n, nPair = 0 ;
+  if (n < 2) return sb->n = 0 ;
+  if (!sb->linkHash) linkSpaceCreate (sb) ;
+  U64 *hash = sb->linkHash, *id = sb->linkId, *pair = sb->linkPair ;
+  int *pos = sb->linkPos, *fwd = sb->linkFwd, *bwd = sb->linkBwd ;
+  bool *isF = sb->linkIsF ;
+  for (i = 0 ; i < n ; ++i)
+    { U128 x = seqhashBatchKmer (sb, i) ;
+      hash[i] = seqhashKmer (sh, x) ;
+      id[i] = seqhashIsLong (sh) ? hash[i] : (U64)x ;
+      pos[i] = sb->pos[i] ; isF[i] = sb->isF[i] ;
+    }
+  for (i = 0 ; i < n ; ++i)
+    { U64 best = U64MAX ; fwd[i] = bwd[i] = -1 ;
+      for (j = i+1 ; j < n && pos[j] - pos[i] <= sh->link ; ++j)
+	if ((hash[i] ^ hash[j]) < best) { best = hash[i] ^ hash[j] ; fwd[i] = j ; }
+      best = U64MAX ;
+      for (j = i-1 ; j >= 0 && pos[i] - pos[j] <= sh->link ; --j)
+	if ((hash[i] ^ hash[j]) < best) { best = hash[i] ^ hash[j] ; bwd[i] = j ; }
+    }
+  for (i = 0 ; i < n ; ++i)
+    { if (fwd[i] >= 0) pair[nPair++] = ((U64)i << 32) | fwd[i] ;
+      if (bwd[i] >= 0 && fwd[bwd[i]] != i) pair[nPair++] = ((U64)bwd[i] << 32) | i ;
+    }
+  qsort (pair, nPair, sizeof(U64), pairOrder) ;
+
+  for (i = 0 ; i < nPair ; ++i)	/* seqhashBatchReserve() made space for 2n */
+    { int a = pair[i] >> 32, b = pair[i] & 0xffffffff ;
+      U64 lo = id[a] < id[b] ? id[a] : id[b], hi = id[a] < id[b] ? id[b] : id[a] ;
+      sb->kmer[i] = lo * sh->factor2 + hi ;
+      if (sb->kmerHi) sb->kmerHi[i] = 0 ;
+      sb->pos[i] = pos[a] ;
+      sb->isF[i] = (hash[a] < hash[b]) ? isF[a] : isF[b] ;
+    }
+  return sb->n = nPair ;
+}
+
+int modRCbatch (Seqhash *sh, char *s, int len, SeqhashBatch *sb)
+{
+  sb->n = 0 ;
+  if (len < sh->k) return 0 ;
+  seqhashBatchReserve (sh, sb, len) ; /* so no checks in the loops */
+
+  if (seqhashIsLong (sh)) sb->n = modRCbatchLong (sh, s, 0, len, sb, false) ;
+  else sb->n = sh->modKernel (sh, s, len - sh->k + 1, sb->kmer, sb->pos, sb->isF) ;
+  if (sh->link) modLinkBatch (sh, sb) ;
+  return sb->n ;
+}
+
+/* Version that reads 2-bit codes directly from packed sequence, as from a BINARY SeqIO file
+   with isPacked set, so avoiding unpacking to one char per base.  Base i is in the top bits
+   of u[i>>2] shifted left by 2*(i&3).  Positions are relative to start.
+*/
+
+int modRCbatchPacked (Seqhash *sh, U8 *u, int start, int len, SeqhashBatch *sb)
+{
+  sb->n = 0 ;
+  if (len < sh->k) return 0 ;
+  seqhashBatchReserve (sh, sb, len) ;
+
+  if (seqhashIsLong (sh)) sb->n = modRCbatchLong (sh, (char*)u, start, len, sb, true) ;
+  else sb->n = sh->modKernelPacked (sh, u, start, len - sh->k + 1, sb->kmer, sb->pos, sb->isF) ;
+  if (sh->link) modLinkBatch (sh, sb) ;
+  return sb->n ;
+}
+
+/* Parallel version for chromosome-scale sequences.  The kmer start positions are split into
+   nThreads chunks, each of which is scanned by the kernel over its own bases plus the k-1
+   following ones, so no kmer is lost or duplicated at the boundaries.  As for the lanes,
+   each chunk writes its hits into the output at its own start position, then positions are
+   offset and the regions closed up so the result is identical to modRCbatch().
+*/
+
+#define SEQHASH_CHUNK_MIN (1 << 20) /* minimum kmers per chunk for threading to be worthwhile */
+
+int modRCbatchThreads (Seqhash *sh, char *s, int len, SeqhashBatch *sb, int nThreads)
+{
+  int nKmer = len - sh->k + 1 ;
+  int nChunk = nKmer / SEQHASH_CHUNK_MIN ;
+  if (nChunk > nThreads) nChunk = nThreads ;
+  if (nChunk < 2 || seqhashIsLong (sh)) return modRCbatch (sh, s, len, sb) ; /* long k serial */
+  seqhashBatchReserve (sh, sb, len) ;
+
+  int c, m = nKmer / nChunk ;
+  int *n = new (nChunk, int) ;
+#ifdef OMP
+#pragma omp parallel for num_threads(nChunk)
+#endif
+  for (c = 0 ; c < nChunk ; ++c)
+    { int i, start = c*m, end = (c == nChunk-1) ? nKmer : start + m ;
+      n[c] = sh->modKernel (sh, s + start, end - start,
+			    sb->kmer + start, sb->pos + start, sb->isF + start) ;
+      for (i = start ; i < start + n[c] ; ++i) sb->pos[i] += start ;
+    }
+
+  sb->n = n[0] ;		/* close up the chunk regions */
+  for (c = 1 ; c < nChunk ; ++c)
+    { memmove (sb->kmer+sb->n, sb->kmer+c*m, n[c]*sizeof(U64)) ;
+      memmove (sb->pos+sb->n, sb->pos+c*m, n[c]*sizeof(int)) ;
+      memmove (sb->isF+sb->n, sb->isF+c*m, n[c]*sizeof(bool)) ;
+      sb->n += n[c] ;
+    }
+  free (n) ;
+  if (sh->link) modLinkBatch (sh, sb) ;
+  return sb->n ;
+}
+
+char *seqString (U128 kmer, int len)
 {
   static char trans[4] = { 'a', 'c', 'g', 't' } ;
-  static char buf[33] ;
-  assert (len <= 32) ;
+  static char buf[64] ;
+  assert (len < 64) ;
   buf[len] = 0 ;
   while (len--) { buf[len] = trans[kmer & 0x3] ; kmer >>= 2 ; }
   return buf ;
@@ -210,23 +698,244 @@ char *seqString (U64 kmer, int len)
 #ifdef TEST
 
 #include "seqio.h"
+#include <time.h>
+
+/* the original minimizer iterator, which rescans the whole window after each minimizer,
+   kept here to check and time the block version against
+*/
+
+static SeqhashRCiterator *minimizerRCiteratorRescan (Seqhash *sh, char *s, int len)
+{
+  assert (s && len >= 0) ;
+  SeqhashRCiterator *si = (SeqhashRCiterator*) mycalloc (sizeof(SeqhashRCiterator), 1) ;
+  si->sh = sh ;
+  si->s = s ; si->sEnd = s + len ;
+  si->hashBuf = new0 (sh->w, U64) ;
+  si->fBuf = new0 (sh->w, bool) ;
+  if (len < sh->k) { si->isDone = true ; return si ; } /* edge case */
+
+  int i ;			/* preinitialise the hashes for the first kmer */
+  for (i = 0 ; i < sh->k ; ++i, ++si->s)
+    { si->h = (si->h << 2) | *si->s ;
+      si->hRC = (si->hRC >> 2) | sh->patternRC[*(si->s)] ;
+    }
+  
+  /* store first w hashes in hashBuf and set ->iMin */
+  U64 min = si->hashBuf[0] = hashRC (si, si->fBuf) ;
+  si->iMin = 0 ;
+  for (i = 1 ; i < sh->w ; ++i, ++si->s)
+    { si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
+      if (si->hashBuf[i] < min) { min = si->hashBuf[i] ; si->iMin = i ; }
+    }
+
+  return si ;
+}
+
+static bool minimizerRCnextRescan (SeqhashRCiterator *si, U64 *u, int *pos, bool *isF) /* returns u,pos,isF */
+{
+  if (si->isDone) return false ; /* we are done */
+
+  assert (u) ;
+  *u = si->hashBuf[si->iMin] ;
+  if (pos) { *pos = si->base + si->iMin ; if (si->iMin < si->iStart) *pos += si->sh->w ; }
+  if (isF) *isF = si->fBuf[si->iMin] ;
+  if (si->s >= si->sEnd) { si->isDone = true ; return true ; }
+
+  int i ;	    		/* next update hashBuf splitting into two cases */
+  U64 min = *u ;    /* save this here for end case - see below */
+  if (si->iMin >= si->iStart)
+    for (i = si->iStart ; i <= si->iMin ; ++i, ++si->s)
+      si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
+  else
+    { for (i = si->iStart ; i < si->sh->w ; ++i, ++si->s)
+	si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
+      si->base += si->sh->w ;
+      for (i = 0 ; i <= si->iMin ; ++i, ++si->s)
+	si->hashBuf[i] = advanceHashRC (si, &si->fBuf[i]) ;
+    }
+  si->iStart = si->iMin + 1 ;
+  if (si->iStart == si->sh->w) { si->iStart = 0 ; si->base += si->sh->w ; }
+
+  /* finally find new min to set up for next call */
+  if (si->hashBuf[si->iMin] != U64MAX) /* there was a full new window */
+    min = U64MAX ;
+  else				/* otherwise, keep the last min */
+    si->iMin = -1 ;
+  for (i = 0 ; i < si->sh->w ; ++i)
+    if (si->hashBuf[i] < min) { min = si->hashBuf[i] ; si->iMin = i ; }
+  if (si->iMin == -1)		/* our old min was not beaten - we are done */
+    si->isDone = true ;
+  
+  return true ;
+}
+
+static void batchThreadsCompare (int len, int nThreads)
+{
+  char *s = new (len, char) ;
+  int i ; for (i = 0 ; i < len ; ++i) s[i] = random() & 3 ;
+  Seqhash *sh = seqhashCreate (21, 31, 0) ;
+  SeqhashBatch *sb = seqhashBatchCreate (1024), *sbT = seqhashBatchCreate (1024) ;
+  modRCbatch (sh, s, len, sb) ; modRCbatchThreads (sh, s, len, sbT, nThreads) ; /* warm up */
+
+  struct timespec t0, t1, t2 ;	/* wall clock, since clock() sums over threads */
+  clock_gettime (CLOCK_MONOTONIC, &t0) ;
+  modRCbatch (sh, s, len, sb) ;
+  clock_gettime (CLOCK_MONOTONIC, &t1) ;
+  modRCbatchThreads (sh, s, len, sbT, nThreads) ;
+  clock_gettime (CLOCK_MONOTONIC, &t2) ;
+  if (sb->n != sbT->n) die ("threaded batch found %d modimizers, serial %d", sbT->n, sb->n) ;
+  for (i = 0 ; i < sb->n ; ++i)
+    if (sb->kmer[i] != sbT->kmer[i] || sb->pos[i] != sbT->pos[i] || sb->isF[i] != sbT->isF[i])
+      die ("threaded batch mismatch at %d", i) ;
+  double d1 = (t1.tv_sec - t0.tv_sec) + 1e-9*(t1.tv_nsec - t0.tv_nsec) ;
+  double d2 = (t2.tv_sec - t1.tv_sec) + 1e-9*(t2.tv_nsec - t1.tv_nsec) ;
+  printf ("%d modimizers in %d bp, serial %.1f Mbp/s, %d threads %.1f Mbp/s\n",
+	  sb->n, len, len / (1e6 * d1), nThreads, len / (1e6 * d2)) ;
+  seqhashBatchDestroy (sb) ; seqhashBatchDestroy (sbT) ; seqhashDestroy (sh) ; free (s) ;
+}
+
+static void longCompare (int len) /* check the k > 31 path directly, and time k 31 vs 51 */
+{
+  char *s = new (len, char) ;
+  U8 *u = new0 (len/4 + 1, U8) ;
+  int i, j ; for (i = 0 ; i < len ; ++i) { s[i] = random() & 3 ; u[i>>2] |= s[i] << (6 - 2*(i & 0x3)) ; }
+  Seqhash *sh = seqhashCreate (51, 31, 0) ;
+  SeqhashBatch *sb = seqhashBatchCreate (1024), *sbP = seqhashBatchCreate (1024) ;
+  int n = modRCbatch (sh, s, len, sb), m = 0 ;
+  for (i = 0 ; i + sh->k <= len ; ++i)
+    { U128 h = 0, hRC = 0 ;
+      for (j = 0 ; j < sh->k ; ++j) { h = (h << 2) | s[i+j] ; hRC = (hRC << 2) | (3 ^ s[i+sh->k-1-j]) ; }
+      U64 hashF = seqhashLong (sh, h), hashR = seqhashLong (sh, hRC) ;
+      if ((hashF < hashR ? hashF : hashR) % sh->w) continue ;
+      if (m >= n || seqhashBatchKmer (sb, m) != (hashF < hashR ? h : hRC) || sb->pos[m] != i
+	  || sb->isF[m] != (hashF < hashR))
+	die ("long batch mismatch at %d", m) ;
+      ++m ;
+    }
+  if (m != n) die ("long batch found %d modimizers, direct %d", n, m) ;
+  modRCbatchPacked (sh, u, 0, len, sbP) ;
+  if (sbP->n != n) die ("long packed batch found %d modimizers, batch %d", sbP->n, n) ;
+  for (i = 0 ; i < n ; ++i)
+    if (seqhashBatchKmer (sb, i) != seqhashBatchKmer (sbP, i) || sb->pos[i] != sbP->pos[i])
+      die ("long packed batch mismatch at %d", i) ;
+
+  Seqhash *sh31 = seqhashCreate (31, 31, 0) ;
+  SeqhashBatch *sb31 = seqhashBatchCreate (1024) ;
+  modRCbatch (sh31, s, len, sb31) ;
+  clock_t t0 = clock () ;
+  modRCbatch (sh31, s, len, sb31) ;
+  clock_t t1 = clock () ;
+  modRCbatch (sh, s, len, sb) ;
+  clock_t t2 = clock () ;
+  printf ("%d bp: k 31 %d modimizers %.1f Mbp/s, k 51 %d modimizers %.1f Mbp/s\n", len,
+	  sb31->n, len / (1e6 * (t1-t0) / CLOCKS_PER_SEC), n, len / (1e6 * (t2-t1) / CLOCKS_PER_SEC)) ;
+  seqhashBatchDestroy (sb) ; seqhashBatchDestroy (sbP) ; seqhashBatchDestroy (sb31) ;
+  seqhashDestroy (sh) ; seqhashDestroy (sh31) ; free (s) ; free (u) ;
+}
+
+static void linkCompare (int len, int link) /* linked seeds must be the same from both strands */
+{
+  char *s = new (len, char), *r = new (len, char) ;
+  int i, j ; for (i = 0 ; i < len ; ++i) s[i] = random() & 3 ;
+  for (i = 0 ; i < len ; ++i) r[len-1-i] = 3 ^ s[i] ;
+  Seqhash *sh = seqhashCreate (19, 31, 0) ; sh->link = link ;
+  SeqhashBatch *sb = seqhashBatchCreate (1024), *sbR = seqhashBatchCreate (1024) ;
+  clock_t t0 = clock () ;
+  modRCbatch (sh, s, len, sb) ;
+  clock_t t1 = clock () ;
+  modRCbatch (sh, r, len, sbR) ;
+  if (sb->n != sbR->n) die ("linked seeds %d forward, %d reverse", sb->n, sbR->n) ;
+  for (i = 0 ; i < sb->n ; ++i)	/* quadratic, but only a test */
+    { for (j = 0 ; j < sbR->n ; ++j)
+	if (sbR->kmer[j] == sb->kmer[i] && sbR->isF[j] != sb->isF[i]) break ;
+      if (j == sbR->n) die ("linked seed %d at %d missing from reverse strand", i, sb->pos[i]) ;
+    }
+  printf ("%d linked seeds in %d bp with link %d, %.1f Mbp/s\n",
+	  sb->n, len, link, len / (1e6 * (t1-t0) / CLOCKS_PER_SEC)) ;
+  seqhashBatchDestroy (sb) ; seqhashBatchDestroy (sbR) ; seqhashDestroy (sh) ; free (s) ; free (r) ;
+}
+
+static void minimizerCompare (int len, int k, int w, int period) /* period > 0 for tandem repeat */
+{
+  char *s = new (len, char) ;
+  int i ; for (i = 0 ; i < len ; ++i) s[i] = (period && i >= period) ? s[i-period] : random() & 3 ;
+  Seqhash *sh = seqhashCreate (k, w, 0) ;
+  U64 u, u1 ; int pos, pos1 ; bool isF, isF1 ;
+
+  SeqhashRCiterator *si = minimizerRCiterator (sh, s, len) ;
+  SeqhashRCiterator *si1 = minimizerRCiteratorRescan (sh, s, len) ;
+  int n = 0 ;
+  while (minimizerRCnext (si, &u, &pos, &isF))
+    { if (!minimizerRCnextRescan (si1, &u1, &pos1, &isF1)) die ("rescan stopped early at %d", n) ;
+      if (u != u1 || pos != pos1 || isF != isF1) die ("minimizer mismatch at %d pos %d %d", n, pos, pos1) ;
+      ++n ;
+    }
+  if (minimizerRCnextRescan (si1, &u1, &pos1, &isF1)) die ("rescan continues after %d", n) ;
+  seqhashRCiteratorDestroy (si) ; seqhashRCiteratorDestroy (si1) ;
+
+  clock_t t0 = clock () ;
+  si = minimizerRCiterator (sh, s, len) ;
+  while (minimizerRCnext (si, &u, &pos, &isF)) ;
+  seqhashRCiteratorDestroy (si) ;
+  clock_t t1 = clock () ;
+  si = minimizerRCiteratorRescan (sh, s, len) ;
+  while (minimizerRCnextRescan (si, &u, &pos, &isF)) ;
+  seqhashRCiteratorDestroy (si) ;
+  clock_t t2 = clock () ;
+  printf ("k %d w %d period %d: %d minimizers in %d bp, blocks %.1f Mbp/s, rescan %.1f Mbp/s\n", k, w, period, n, len,
+	  len / (1e6 * (t1-t0) / CLOCKS_PER_SEC), len / (1e6 * (t2-t1) / CLOCKS_PER_SEC)) ;
+  seqhashDestroy (sh) ; free (s) ;
+}
 
 int main (int argc, char *argv[])
 {
-  char *seq, *id ;
-  int len ;
-  U64 u, k ; int pos ; bool isF ;
+  U64 u ; int pos ; bool isF ;
 
-  SeqIO *sio = seqIOopen ("-", dna2indexConv, 0) ;
+  if (argc >= 5 && !strcmp (argv[1], "-min")) /* seqhash -min <len> <k> <w> [period] */
+    { minimizerCompare (atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), argc > 5 ? atoi(argv[5]) : 0) ;
+      exit (0) ;
+    }
+  if (argc == 4 && !strcmp (argv[1], "-par")) /* seqhash -par <len> <nThreads> */
+    { batchThreadsCompare (atoi(argv[2]), atoi(argv[3])) ; exit (0) ; }
+  if (argc == 3 && !strcmp (argv[1], "-long")) /* seqhash -long <len> */
+    { longCompare (atoi(argv[2])) ; exit (0) ; }
+  if (argc == 4 && !strcmp (argv[1], "-link")) /* seqhash -link <len> <link> */
+    { linkCompare (atoi(argv[2]), atoi(argv[3])) ; exit (0) ; }
+
+  SeqIO *sio = seqIOopenRead ("-", dna2indexConv, false) ;
   
   Seqhash *sh = seqhashCreate (16, 32, 0) ;
+  SeqhashBatch *sb = seqhashBatchCreate (1024), *sbP = seqhashBatchCreate (1024) ;
+  Array packed = arrayCreate (1024, U8) ;
   while (seqIOread (sio))
-    { printf ("\nread sequence %s length %d\n", sqioId(sio), sio->seqLen) ;
+    { printf ("\nread sequence %s length %d\n", sqioId(sio), (int)sio->seqLen) ;
       SeqhashRCiterator *si = modRCiterator (sh, sqioSeq(sio), sio->seqLen) ;
-      while (modRCnext (si, &u, &pos, &isF, &k))
-	printf ("\t%08lx\t%s\t%d\t%c\n", u, seqString (k, 16), pos, isF?'F':'R') ;
+      int i = 0, n = modRCbatch (sh, sqioSeq(sio), sio->seqLen, sb) ;
+      while (modRCnext (si, &u, &pos, &isF))
+	{ printf ("\t%s\t%d\t%c\n", seqString (u, 16), pos, isF?'F':'R') ;
+	  if (i >= n || sb->kmer[i] != u || sb->pos[i] != pos || sb->isF[i] != isF)
+	    die ("batch mismatch at %d", i) ;
+	  ++i ;
+	}
+      if (i != n) die ("batch found %d modimizers, iterator %d", n, i) ;
       seqhashRCiteratorDestroy (si) ;
+
+      char *s = sqioSeq(sio) ;	/* pack as in a BINARY file, then check against the batch */
+      for (i = 0 ; i < sio->seqLen ; ++i) if ((unsigned) s[i] > 3) break ;
+      if (i < sio->seqLen) continue ; /* packing can't represent ambiguous bases */
+      packed = arrayReCreate (packed, sio->seqLen/4 + 1, U8) ;
+      for (i = 0 ; i < sio->seqLen ; ++i) array(packed, i>>2, U8) |= s[i] << (6 - 2*(i & 0x3)) ;
+      int start = sio->seqLen > 3 ? 3 : 0 ; /* an unaligned start, as for 10x barcodes */
+      n = modRCbatch (sh, s + start, sio->seqLen - start, sb) ;
+      modRCbatchPacked (sh, arrp(packed,0,U8), start, sio->seqLen - start, sbP) ;
+      if (sbP->n != n) die ("packed batch found %d modimizers, batch %d", sbP->n, n) ;
+      for (i = 0 ; i < n ; ++i)
+	if (sb->kmer[i] != sbP->kmer[i] || sb->pos[i] != sbP->pos[i] || sb->isF[i] != sbP->isF[i])
+	  die ("packed batch mismatch at %d", i) ;
     }
+  arrayDestroy (packed) ;
+  seqhashBatchDestroy (sbP) ;
+  seqhashBatchDestroy (sb) ;
   seqIOclose (sio) ;
 }
 
@@ -12,14 +12,21 @@
 
 #include "utils.h"
 
-typedef struct {
+typedef struct SeqhashStruct {
   int seed ;			/* seed */
   int k ;			/* kmer */
   int w ;			/* window */
-  U64 mask ;			/* 2*k bits */
+  U64 mask ;			/* 2*k bits - for k > 31 kmers are U128 and mask is not used */
   int shift1, shift2 ;
   U64 factor1, factor2 ;
   U64 patternRC[4] ;		/* one per base */
+  int link ;			/* if > 0 seeds are linked pairs of modimizers up to link apart */
+  /* below here is derived from the above in seqhashCreate() and seqhashRead(), not written */
+  U64 modInv, modLimit ;	/* hash % w == 0 iff rotateRight (hash*modInv, modShift) <= modLimit */
+  int modShift ;
+  int (*modKernel) (struct SeqhashStruct *sh, char *s, int nKmer, U64 *kmer, int *pos, bool *isF) ;
+  int (*modKernelPacked) (struct SeqhashStruct *sh, U8 *u, int off, int nKmer,
+			  U64 *kmer, int *pos, bool *isF) ;
 } Seqhash ;
 
 typedef struct {
@@ -31,32 +38,91 @@ typedef struct {
   int base ;			/* start of buf in sequence */
   int iStart, iMin ;		/* position in buf of start of current window, next min */
   bool isDone ;
+  int *preMin, *sufMin ;	/* minimizer: prefix and suffix minima within blocks of w */
+  int iEnd, xEnd ;		/* minimizer: last kmer loaded and its place in hashBuf */
+  int pMin, nKmer ;		/* minimizer: position of next min, number of kmers in sequence */
+  char *sOK ;			/* modimizer: kmers ending before sOK-1 contain an ambiguous base */
 } SeqhashRCiterator ;
 
 Seqhash *seqhashCreate (int k, int w, int seed) ;
+Seqhash *seqhashCoarsen (Seqhash *sh, int j) ; /* same hash function, window w << j */
 static void seqhashDestroy (Seqhash *sh) { free (sh) ; }
 
 void seqhashWrite (Seqhash *sh, FILE *f) ;
 Seqhash *seqhashRead (FILE *f) ;
 void seqhashReport (Seqhash *sh, FILE *f) ;
 
+// kmers with k up to 31 fit in a U64; for 32 <= k <= 63 they are U128 and hashed by seqhashLong()
+static inline bool seqhashIsLong (Seqhash *sh) { return sh->k > 31 ; }
+
 // iterator to extract minimizers from a sequence
 // NB sequence must continue to exist through the life of the iterator
+// NB the iterators only support k <= 31 - use modRCbatch() for long kmers
 SeqhashRCiterator *minimizerRCiterator (Seqhash *sh, char *s, int len) ;
 bool minimizerRCnext (SeqhashRCiterator *si, U64 *u, int *pos, bool *isF) ; /* return u,pos,isF */
 
 // modimizer extracts hashes that are divisible by m->w
 // this is faster and more robust to errors - same mean density without evenness guarantees
-SeqhashRCiterator *modRCiterator (Seqhash *sh, char *s, int len) ;
+// sequence codes are 0..3 for ACGT; kmers containing any other code (4 for N, -2 for other
+// IUPAC codes in dna2indexConv) are skipped, by modRCnext() and the batch functions
+// (the minimizer iterator just uses the low 2 bits of such codes)
+SeqhashRCiterator *modRCiterator (Seqhash *sh, char *s, int len) ; /* not for linked seeds */
 bool modRCnext (SeqhashRCiterator *si, U64 *kmer, int *pos, bool *isF) ;
 /* returns any/all of kmer, pos, isF - get hash from seqhash(sh,kmer) */
 
 static void seqhashRCiteratorDestroy (SeqhashRCiterator *si)
-{ free (si->hashBuf) ; free (si->fBuf) ; free (si) ; }
+{ free (si->hashBuf) ; free (si->fBuf) ; free (si->preMin) ; free (si->sufMin) ; free (si) ; }
+
+// batch alternative to modRCiterator/modRCnext: extracts all modimizers of a sequence in one call
+// into caller-owned arrays, which grow as needed and are reused across sequences without reallocation
+typedef struct {
+  int size ;			/* allocated length of the arrays below */
+  int n ;			/* number of modimizers found by the last call */
+  U64 *kmer ;			/* canonical kmer */
+  U64 *kmerHi ;			/* its high 64 bits if k > 31, else kmerHi is 0 */
+  int *pos ;			/* start position in sequence */
+  bool *isF ;			/* true if kmer is on the forward strand */
+  U32 *index ;			/* not set here - for the caller, e.g. modsetIndexFindBatch() */
+  U64 *linkHash, *linkId, *linkPair ; /* work space for linked seeds, made on first use */
+  int *linkPos, *linkFwd, *linkBwd ;   /* linkPair is 2*size, the others size */
+  bool *linkIsF ;
+} SeqhashBatch ;
+
+SeqhashBatch *seqhashBatchCreate (int size) ;
+int modRCbatch (Seqhash *sh, char *s, int len, SeqhashBatch *sb) ; /* fills sb, returns sb->n */
+int modRCbatchPacked (Seqhash *sh, U8 *u, int start, int len, SeqhashBatch *sb) ;
+  /* as modRCbatch() for bases start..start+len-1 of u packed 4 per byte, first in the high bits */
+int modRCbatchThreads (Seqhash *sh, char *s, int len, SeqhashBatch *sb, int nThreads) ;
+  /* same result as modRCbatch(), splitting long sequences into chunks run in parallel with OMP */
+// if sh->link > 0 the batch functions return linked seeds instead of single modimizers:
+// each modimizer is paired with the one within sh->link bases downstream, and the one upstream,
+// that minimise the XOR of their hashes, a pair's kmer is a key combining the two kmers
+// independent of order, and its pos and isF are from the leftmost and lower hash members
+// respectively, so that the seeds on the two strands of a sequence are the same
+
+static void seqhashBatchDestroy (SeqhashBatch *sb)
+{ free (sb->kmer) ; free (sb->kmerHi) ; free (sb->pos) ; free (sb->isF) ; free (sb->index) ;
+  free (sb->linkHash) ; free (sb->linkId) ; free (sb->linkPair) ;
+  free (sb->linkPos) ; free (sb->linkFwd) ; free (sb->linkBwd) ; free (sb->linkIsF) ;
+  free (sb) ;
+}
+static inline U128 seqhashBatchKmer (SeqhashBatch *sb, int i)
+{ return sb->kmerHi ? ((U128)sb->kmerHi[i] << 64) | sb->kmer[i] : sb->kmer[i] ; }
 
 // utilities
 static inline U64 seqhash (Seqhash *sh, U64 k) { return ((k * sh->factor1) >> sh->shift1) ; }
-char *seqString (U64 kmer, int len)  ;
-static inline char* seqhashString (Seqhash *sh, U64 k) { return seqString (k, sh->k) ; }
+static inline U64 seqhashLong (Seqhash *sh, U128 k) /* top 64 bits of k times a 128-bit factor */
+{ return (k * (((U128)sh->factor2 << 64) | sh->factor1)) >> 64 ; }
+static inline U64 seqhashKmer (Seqhash *sh, U128 k) /* either of the above, as needed for sh->k */
+{ return seqhashIsLong (sh) ? seqhashLong (sh, k) : seqhash (sh, (U64)k) ; }
+// modimizers for w << j are a subset of those for w, so one pass gives all densities w, 2w, 4w...
+static inline int seqhashLevel (Seqhash *sh, U64 hash) /* for a modimizer: max j with hash % (w << j) == 0 */
+{ return hash ? __builtin_ctzll (hash) - sh->modShift : 64 ; }
+static inline bool seqhashIsMod (Seqhash *sh, U64 hash) /* hash % sh->w == 0 without division */
+{ hash *= sh->modInv ;
+  return ((hash >> sh->modShift) | (hash << ((64 - sh->modShift) & 63))) <= sh->modLimit ;
+}
+char *seqString (U128 kmer, int len)  ;
+static inline char* seqhashString (Seqhash *sh, U128 k) { return seqString (k, sh->k) ; }
 
 /******* end of file ********/
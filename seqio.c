@@ -284,7 +284,12 @@ bool seqIOread (SeqIO *si)
       si->idStart = si->b - si->buf ;
       si->descStart = si->idStart + si->idLen + 1 ;
       si->seqStart = si->descStart + si->descLen + 1 ;
-      sqioSeqUnpack ((U8*)(si->buf+si->seqStart), si->seqBuf, si->seqLen, si) ;
+      if (si->isPacked)		/* left align the last partial byte so all bytes are alike */
+	{ if (si->seqLen & 0x3)
+	    sqioSeqPacked(si)[si->seqLen >> 2] <<= 2*(4 - (si->seqLen & 0x3)) ;
+	}
+      else
+	sqioSeqUnpack ((U8*)(si->buf+si->seqStart), si->seqBuf, si->seqLen, si) ;
       if (si->isQual)
 	{ si->qualStart = si->seqStart + (si->seqLen + 3) / 4 ;
 	  sqioQualUnpack ((U8*)(si->buf+si->qualStart), si->qualBuf, si->seqLen, si) ;
@@ -577,7 +582,7 @@ void sqioSeqUnpack (U8 *u, char *s, U64 len, SeqIO *si) /* uncompress (len+3)/4
     { *(U32*)s = si->seqExpand[*u] ;
       ++u ; s += 4 ; len -= 4 ;
     }
-  if (len) for (i = len ; --i ; ) { s[i] = si->unpackConvert[*u & 0x3] ; *u >>= 2 ; }
+  if (len) { U8 x = *u ; for (i = len ; i-- ; ) { s[i] = si->unpackConvert[x & 0x3] ; x >>= 2 ; } }
 }
 
 U64 sqioQualPack (char *q, U8 *u, U64 len, int thresh) /* compress q into (len+7)/8 u  */
@@ -27,6 +27,7 @@ typedef struct {
   U64 idStart, descStart, seqStart, qualStart ;
   bool isQual ;			/* if set then convert qualities by subtracting 33 (FASTQ) */
   int qualThresh ;		/* used for binary representation of qualities */
+  bool isPacked ;		/* BINARY only: set to leave sequences packed - see sqioSeqPacked() */
   /* below here private */
   U64 bufSize ;
   U64 nb ;			/* nb is how many characters left to read in the buffer */
@@ -54,6 +55,9 @@ bool seqIOread (SeqIO *si) ;
 #define sqioDesc(si) ((si)->buf+(si)->descStart)
 #define sqioSeq(si)  ((si)->type >= BINARY ? (si)->seqBuf : (si)->buf+(si)->seqStart)
 #define sqioQual(si) ((si)->type >= BINARY ? (si)->qualBuf : (si)->buf+(si)->qualStart)
+/* if isPacked, BINARY sequences are left as 4 2-bit codes per byte, first base in the high bits, */
+/* with the last partial byte shifted to match */
+#define sqioSeqPacked(si) ((U8*)(si)->buf+(si)->seqStart)
 
 SeqIO *seqIOopenWrite (char *filename, SeqIOtype type, int* convert, int qualThresh) ;
 void seqIOwrite (SeqIO *si, char *id, char *desc, U64 seqLen, char *seq, char *qual) ;
@@ -38,6 +38,7 @@ typedef uint32_t U32 ;
 const static U32 U32MAX = 0xffffffff ;
 typedef uint64_t U64 ;
 const static U64 U64MAX = 0xffffffffffffffff ;
+typedef unsigned __int128 U128 ; /* gcc and clang */
 #endif
 
 #include "array.h"